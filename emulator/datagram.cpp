@@ -0,0 +1,195 @@
+#include "datagram.h"
+#include <algorithm>
+#include <array>
+#include <print>
+#include <stdexcept>
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cerrno>
+#endif
+using namespace gamespy;
+using boost::asio::ip::udp;
+
+#if defined(SO_REUSEPORT)
+using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
+DatagramSocket::DatagramSocket(boost::asio::io_context& context, const udp::endpoint& endpoint, bool reusePort)
+	: m_Socket{ context, endpoint.protocol() },
+	m_ReceiveBuffer(BATCH_SIZE * MAX_DATAGRAM_SIZE), m_ReceiveEndpoints(BATCH_SIZE)
+{
+	if (reusePort) {
+#if defined(SO_REUSEPORT)
+		m_Socket.set_option(reuse_port{ true });
+#else
+		throw std::runtime_error{ "SO_REUSEPORT is not supported on this platform" };
+#endif
+	}
+
+	m_Socket.bind(endpoint);
+
+	// all reads and writes are done by hand once the socket signaled readiness,
+	// so they must never block the io thread
+	m_Socket.non_blocking(true);
+	m_Received.reserve(BATCH_SIZE);
+	m_Pending.reserve(BATCH_SIZE);
+}
+
+DatagramSocket::~DatagramSocket()
+{
+
+}
+
+boost::asio::awaitable<std::span<const DatagramSocket::Datagram>> DatagramSocket::Receive()
+{
+	m_Received.clear();
+	while (m_Received.empty()) {
+		const auto [error] = co_await m_Socket.async_wait(udp::socket::wait_read, boost::asio::as_tuple(boost::asio::use_awaitable));
+		if (error) {
+			// anything but a cancellation would fail again right away, so close the
+			// socket to end the caller's receive loop instead of spinning on it
+			if (error != boost::asio::error::operation_aborted) {
+				std::println("[datagram] wait failed: {}", error.message());
+				boost::system::error_code ignored;
+				m_Socket.close(ignored);
+			}
+			co_return std::span<const Datagram>{};
+		}
+
+		m_Stats.wakeups++;
+		ReceiveBatch();
+	}
+
+	m_Stats.received += m_Received.size();
+	m_Stats.max_received = std::max<std::uint64_t>(m_Stats.max_received, m_Received.size());
+	co_return std::span<const Datagram>{ m_Received };
+}
+
+void DatagramSocket::ReceiveBatch()
+{
+#if defined(__linux__)
+	std::array<mmsghdr, BATCH_SIZE> headers{};
+	std::array<iovec, BATCH_SIZE> buffers{};
+	for (std::size_t i = 0; i < BATCH_SIZE; i++) {
+		buffers[i].iov_base = m_ReceiveBuffer.data() + i * MAX_DATAGRAM_SIZE;
+		buffers[i].iov_len = MAX_DATAGRAM_SIZE;
+		headers[i].msg_hdr.msg_name = m_ReceiveEndpoints[i].data();
+		headers[i].msg_hdr.msg_namelen = static_cast<socklen_t>(m_ReceiveEndpoints[i].capacity());
+		headers[i].msg_hdr.msg_iov = &buffers[i];
+		headers[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	const int count = ::recvmmsg(m_Socket.native_handle(), headers.data(), static_cast<unsigned int>(BATCH_SIZE), MSG_DONTWAIT, nullptr);
+	for (int i = 0; i < count; i++) {
+		const auto length = static_cast<std::size_t>(headers[i].msg_len);
+		if (length == 0 || (headers[i].msg_hdr.msg_flags & MSG_TRUNC))
+			continue;
+
+		m_ReceiveEndpoints[i].resize(headers[i].msg_hdr.msg_namelen);
+		m_Received.push_back(Datagram{
+			.endpoint = m_ReceiveEndpoints[i],
+			.data = { m_ReceiveBuffer.data() + i * MAX_DATAGRAM_SIZE, length }
+		});
+	}
+#else
+	for (std::size_t i = 0; i < BATCH_SIZE; i++) {
+		auto buffer = boost::asio::buffer(m_ReceiveBuffer.data() + i * MAX_DATAGRAM_SIZE, MAX_DATAGRAM_SIZE);
+		boost::system::error_code ec;
+		const auto length = m_Socket.receive_from(buffer, m_ReceiveEndpoints[i], 0, ec);
+		if (ec == boost::asio::error::would_block)
+			break;
+		else if (ec || length == 0)
+			continue; // e.g. connection_reset caused by an icmp "port unreachable" of a previous reply
+
+		m_Received.push_back(Datagram{
+			.endpoint = m_ReceiveEndpoints[i],
+			.data = { m_ReceiveBuffer.data() + i * MAX_DATAGRAM_SIZE, length }
+		});
+	}
+#endif
+}
+
+void DatagramSocket::Send(const udp::endpoint& endpoint, const std::span<const std::uint8_t>& data)
+{
+	if (m_Pending.size() - m_FirstPending >= MAX_PENDING) {
+		m_Stats.dropped++;
+		return;
+	}
+
+	m_Pending.push_back(pending_t{
+		.endpoint = endpoint,
+		.offset = m_SendBuffer.size(),
+		.length = data.size()
+	});
+	m_SendBuffer.insert(m_SendBuffer.end(), data.begin(), data.end());
+}
+
+std::size_t DatagramSocket::SendBatch(std::size_t first, boost::system::error_code& ec)
+{
+	const auto count = std::min(BATCH_SIZE, m_Pending.size() - first);
+#if defined(__linux__)
+	std::array<mmsghdr, BATCH_SIZE> headers{};
+	std::array<iovec, BATCH_SIZE> buffers{};
+	for (std::size_t i = 0; i < count; i++) {
+		auto& pending = m_Pending[first + i];
+		buffers[i].iov_base = m_SendBuffer.data() + pending.offset;
+		buffers[i].iov_len = pending.length;
+		headers[i].msg_hdr.msg_name = pending.endpoint.data();
+		headers[i].msg_hdr.msg_namelen = static_cast<socklen_t>(pending.endpoint.size());
+		headers[i].msg_hdr.msg_iov = &buffers[i];
+		headers[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	const int sent = ::sendmmsg(m_Socket.native_handle(), headers.data(), static_cast<unsigned int>(count), MSG_DONTWAIT);
+	if (sent >= 0)
+		return static_cast<std::size_t>(sent);
+
+	if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		ec = boost::asio::error::would_block;
+		return 0;
+	}
+
+	// the first reply could not be sent at all, drop it so the remaining ones are not stuck behind it
+	ec = boost::system::error_code{ errno, boost::system::system_category() };
+	return 1;
+#else
+	for (std::size_t i = 0; i < count; i++) {
+		const auto& pending = m_Pending[first + i];
+		m_Socket.send_to(boost::asio::buffer(m_SendBuffer.data() + pending.offset, pending.length), pending.endpoint, 0, ec);
+		if (ec == boost::asio::error::would_block)
+			return i;
+	}
+
+	return count;
+#endif
+}
+
+void DatagramSocket::Flush()
+{
+	// while waiting for the socket to become writable, new replies are only queued
+	if (m_WaitingForWrite)
+		return;
+
+	while (m_FirstPending < m_Pending.size()) {
+		boost::system::error_code ec;
+		const auto sent = SendBatch(m_FirstPending, ec);
+		m_FirstPending += sent;
+		m_Stats.flushes++;
+		m_Stats.sent += sent;
+
+		if (ec == boost::asio::error::would_block) {
+			m_WaitingForWrite = true;
+			m_Socket.async_wait(udp::socket::wait_write, [this](const boost::system::error_code& error) {
+				m_WaitingForWrite = false;
+				if (!error)
+					Flush();
+			});
+			return;
+		}
+	}
+
+	m_Pending.clear();
+	m_SendBuffer.clear();
+	m_FirstPending = 0;
+}
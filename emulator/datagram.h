@@ -0,0 +1,91 @@
+#pragma once
+#ifndef _GAMESPY_DATAGRAM_H_
+#define _GAMESPY_DATAGRAM_H_
+
+#include "asio.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace gamespy {
+	// udp socket which receives and sends in batches:
+	// - Receive waits until the socket is readable and then drains up to BATCH_SIZE datagrams (recvmmsg where available)
+	// - Send only queues a reply, all queued replies are sent with the next Flush (sendmmsg where available)
+	// - Flush never suspends the caller: if the socket buffer is full, the remaining replies are sent once the socket is writable again
+	class DatagramSocket {
+	public:
+		static constexpr std::size_t BATCH_SIZE = 64;
+		static constexpr std::size_t MAX_DATAGRAM_SIZE = 1400;
+		static constexpr std::size_t MAX_PENDING = 16 * BATCH_SIZE; // replies exceeding this are dropped while the socket is not writable
+
+		struct Datagram {
+			boost::asio::ip::udp::endpoint endpoint;
+			std::span<const std::uint8_t> data; // only valid until the next call to Receive
+		};
+
+		struct Stats {
+			std::uint64_t wakeups = 0;
+			std::uint64_t received = 0;
+			std::uint64_t max_received = 0; // most datagrams received within a single wakeup
+			std::uint64_t flushes = 0;
+			std::uint64_t sent = 0;
+			std::uint64_t dropped = 0; // replies which were not queued because too many were pending
+
+			double ReceivedPerWakeup() const noexcept { return wakeups ? static_cast<double>(received) / wakeups : 0.0; }
+			double SentPerFlush() const noexcept { return flushes ? static_cast<double>(sent) / flushes : 0.0; }
+		};
+
+	private:
+		struct pending_t {
+			boost::asio::ip::udp::endpoint endpoint;
+			std::size_t offset;
+			std::size_t length;
+		};
+
+		boost::asio::ip::udp::socket m_Socket;
+
+		std::vector<std::uint8_t> m_ReceiveBuffer; // BATCH_SIZE * MAX_DATAGRAM_SIZE
+		std::vector<boost::asio::ip::udp::endpoint> m_ReceiveEndpoints;
+		std::vector<Datagram> m_Received;
+
+		std::vector<std::uint8_t> m_SendBuffer; // all queued replies back to back
+		std::vector<pending_t> m_Pending;
+		std::size_t m_FirstPending = 0; // replies before this one have already been sent
+		bool m_WaitingForWrite = false;
+
+		Stats m_Stats;
+
+	public:
+		// reusePort: allows multiple sockets to be bound to the same endpoint (SO_REUSEPORT),
+		// the kernel then distributes the incoming datagrams by their source endpoint among those sockets
+		DatagramSocket(boost::asio::io_context& context, const boost::asio::ip::udp::endpoint& endpoint, bool reusePort = false);
+		~DatagramSocket();
+
+		static constexpr bool SupportsReusePort() noexcept
+		{
+#if defined(SO_REUSEPORT)
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		bool is_open() const { return m_Socket.is_open(); }
+		const Stats& GetStats() const noexcept { return m_Stats; }
+
+		// returns an empty span if the socket was closed, or failed (in which case it is closed)
+		boost::asio::awaitable<std::span<const Datagram>> Receive();
+
+		void Send(const boost::asio::ip::udp::endpoint& endpoint, const std::span<const std::uint8_t>& data);
+		void Flush();
+
+	private:
+		void ReceiveBatch();
+
+		// sends queued replies beginning at `first`, returns the number of replies which were handled
+		// (ec is set to would_block if the socket buffer is full)
+		std::size_t SendBatch(std::size_t first, boost::system::error_code& ec);
+	};
+}
+
+#endif
@@ -1,14 +1,43 @@
 #include "dns.h"
 #include "dns_details.h"
+#include "gamedb.h"
+#include <algorithm>
 #include <array>
+#include <cctype>
 #include <print>
 using boost::asio::ip::udp;
 using namespace gamespy;
 
-void HandlePacket(dns::dns_packet& packet)
+namespace {
+	// the hosts of the master servers of a game (%s.master.gamespy.com, %s.available.gamespy.com and %s.ms%d.gamespy.com)
+	// only exist for known games, all other hosts exist
+	bool HostExists(GameDB& db, const std::string_view& name)
+	{
+		constexpr auto DOMAIN = std::string_view{ ".gamespy.com" };
+		if (!name.ends_with(DOMAIN))
+			return true;
+
+		const auto host = name.substr(0, name.size() - DOMAIN.size());
+		const auto dot = host.find('.');
+		if (dot == std::string_view::npos)
+			return true;
+
+		const auto service = host.substr(dot + 1);
+		const auto isMaster = service == "master" || service == "available" ||
+			(service.size() > 2 && service.starts_with("ms") && std::ranges::all_of(service.substr(2), [](unsigned char c) { return std::isdigit(c); }));
+		return !isMaster || db.HasGame(host.substr(0, dot));
+	}
+}
+
+void HandlePacket(GameDB& db, dns::dns_packet& packet)
 {
 	for (const auto& q : packet.questions) {
 		if ((q.type == dns::dns_question::QTYPE::A || q.type == dns::dns_question::QTYPE::AAAA) && q.klass == dns::dns_question::QCLASS::INTERNET) {
+			if (!HostExists(db, q.name)) {
+				packet.response_type = dns::dns_packet::RCODE::NXDomain;
+				break;
+			}
+
 			if (q.name.ends_with("gamespy.com") || q.name.ends_with("dice.se")) {
 				auto data = std::vector<std::uint8_t>{};
 				if (q.type == dns::dns_question::QTYPE::A)
@@ -39,8 +68,8 @@ void HandlePacket(dns::dns_packet& packet)
 	packet.recursion_available = false;
 }
 
-DNSServer::DNSServer(boost::asio::io_context& context, GameDB& db)
-	: m_Socket(context, udp::endpoint(udp::v6(), PORT)), m_DB(db)
+DNSServer::DNSServer(boost::asio::io_context& context, GameDB& db, const params_t& params)
+	: m_Socket(context, udp::endpoint(udp::v6(), PORT)), m_DB(db), m_RateLimiter(params.rate_limit)
 {
 	std::println("[dns] listening on {} for *.gamespy.com", PORT);
 }
@@ -59,11 +88,19 @@ boost::asio::awaitable<void> DNSServer::AcceptConnections()
 		if (error || length == 0)
 			continue;
 
+		if (const auto now = RateLimiter::Clock::now(); !m_RateLimiter.Allow(client.address(), now)) {
+			if (now - m_LastDropReport >= DROP_REPORT_INTERVAL) {
+				std::println("[dns] rate limiting {}, {} packets dropped so far", client.address().to_string(), m_RateLimiter.GetStats().dropped);
+				m_LastDropReport = now;
+			}
+			continue;
+		}
+
 		auto packet = dns::dns_packet::from_bytes(buff);
 		if (!packet || packet->questions.size() == 0)
 			continue;
 
-		HandlePacket(*packet);
+		HandlePacket(m_DB, *packet);
 		co_await m_Socket.async_send_to(boost::asio::buffer(packet->to_bytes()), client, boost::asio::use_awaitable);
 	}
 }
\ No newline at end of file
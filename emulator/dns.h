@@ -3,17 +3,29 @@
 #define _GAMESPY_DNS_H_
 
 #include "asio.h"
+#include "ratelimit.h"
 namespace gamespy
 {
 	class GameDB;
 	class DNSServer
 	{
 		static constexpr boost::asio::ip::port_type PORT = 53;
+		static constexpr auto DROP_REPORT_INTERVAL = std::chrono::seconds{ 60 };
+
+	public:
+		struct params_t
+		{
+			const RateLimiter::params_t rate_limit = {};
+		};
+
+	private:
 		boost::asio::ip::udp::socket m_Socket;
 		GameDB& m_DB;
+		RateLimiter m_RateLimiter;
+		RateLimiter::Clock::time_point m_LastDropReport;
 
 	public:
-		DNSServer(boost::asio::io_context& context, GameDB& db);
+		DNSServer(boost::asio::io_context& context, GameDB& db, const params_t& params);
 		~DNSServer();
 
 		boost::asio::awaitable<void> AcceptConnections();
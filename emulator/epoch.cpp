@@ -0,0 +1,60 @@
+#include "epoch.h"
+#include <algorithm>
+#include <functional>
+#include <thread>
+using namespace gamespy;
+
+EpochReclaimer::Guard::~Guard()
+{
+	m_Slot->store(IDLE, std::memory_order_release);
+}
+
+EpochReclaimer::EpochReclaimer()
+{
+
+}
+
+EpochReclaimer::~EpochReclaimer()
+{
+
+}
+
+EpochReclaimer::Guard EpochReclaimer::Pin() noexcept
+{
+	// threads start searching at different slots, so they rarely compete for the same one
+	const auto start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+	for (;;) {
+		for (std::size_t i = 0; i < MAX_READERS; i++) {
+			auto& slot = m_Slots[(start + i) % MAX_READERS].epoch;
+			auto expected = IDLE;
+			// sequentially consistent: the writer either sees the pinned epoch, or the reader sees the replaced object
+			if (slot.load(std::memory_order_relaxed) == IDLE && slot.compare_exchange_strong(expected, m_Epoch.load()))
+				return Guard{ &slot };
+		}
+
+		std::this_thread::yield();
+	}
+}
+
+void EpochReclaimer::Retire(std::shared_ptr<const void> object)
+{
+	if (!object)
+		return;
+
+	// readers which pinned this epoch (or an older one) might still use the object
+	m_Retired.push_back(retired_t{ .epoch = m_Epoch.fetch_add(1), .object = std::move(object) });
+}
+
+void EpochReclaimer::Reclaim()
+{
+	if (m_Retired.empty())
+		return;
+
+	auto oldest = IDLE;
+	for (const auto& slot : m_Slots)
+		oldest = std::min(oldest, slot.epoch.load());
+
+	// objects are retired in the order of their epochs
+	const auto reclaimable = std::ranges::find_if(m_Retired, [oldest](const retired_t& retired) { return retired.epoch >= oldest; });
+	m_Retired.erase(m_Retired.begin(), reclaimable);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#ifndef _GAMESPY_EPOCH_H_
+#define _GAMESPY_EPOCH_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace gamespy {
+	// epoch-based reclamation of objects which are read without locks:
+	// - readers pin the current epoch (Pin) before they load the published object and unpin it once they are done
+	// - writers replace the published object and retire the old one, which is tagged with the epoch at that time
+	// - Reclaim deletes the retired objects whose epoch is older than the epoch of every pinned reader
+	// Note: Retire and Reclaim must not be called concurrently (the owner serializes its writers), Pin is thread-safe
+	class EpochReclaimer {
+	public:
+		static constexpr std::size_t MAX_READERS = 64; // concurrent readers, further readers wait for a free slot
+
+		// unpins the epoch when it goes out of scope
+		class Guard {
+			friend class EpochReclaimer;
+			std::atomic<std::uint64_t>* m_Slot;
+
+			Guard(std::atomic<std::uint64_t>* slot) noexcept : m_Slot{ slot } {}
+
+		public:
+			Guard(const Guard&) = delete;
+			Guard& operator=(const Guard&) = delete;
+			~Guard();
+		};
+
+	private:
+		static constexpr std::uint64_t IDLE = ~std::uint64_t{ 0 };
+
+		struct retired_t {
+			std::uint64_t epoch;
+			std::shared_ptr<const void> object;
+		};
+
+		std::atomic<std::uint64_t> m_Epoch{ 0 };
+		// slots are padded, so readers on different threads do not share cache lines
+		struct alignas(64) slot_t {
+			std::atomic<std::uint64_t> epoch{ IDLE };
+		};
+		std::array<slot_t, MAX_READERS> m_Slots;
+		std::vector<retired_t> m_Retired;
+
+	public:
+		EpochReclaimer();
+		~EpochReclaimer();
+
+		[[nodiscard]] Guard Pin() noexcept;
+
+		// the object is deleted once no reader might use it anymore (the reclaimer holds the last reference)
+		void Retire(std::shared_ptr<const void> object);
+		void Reclaim();
+
+		std::size_t GetRetiredCount() const noexcept { return m_Retired.size(); }
+	};
+}
+
+#endif
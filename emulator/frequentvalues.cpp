@@ -0,0 +1,107 @@
+#include "frequentvalues.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+using namespace gamespy;
+
+FrequentValues::FrequentValues(std::size_t capacity)
+	: m_Capacity{ capacity }
+{
+	if (capacity == 0)
+		throw std::invalid_argument{ "capacity of the frequent values must not be 0" };
+
+	m_Counters.reserve(m_Capacity);
+	m_Heap.reserve(m_Capacity);
+	m_HeapPositions.reserve(m_Capacity);
+	m_Ids.reserve(m_Capacity);
+}
+
+void FrequentValues::Add(const std::string_view& value, std::uint64_t weight)
+{
+	if (const auto id = m_Ids.find(value); id != m_Ids.end()) {
+		m_Counters[id->second].count += weight;
+		SiftDown(m_HeapPositions[id->second]);
+		return;
+	}
+
+	if (m_Counters.size() < m_Capacity) {
+		const auto id = static_cast<std::uint32_t>(m_Counters.size());
+		const auto& counter = m_Counters.emplace_back(std::string{ value }, weight, 0);
+		m_Ids.emplace(counter.value, id);
+		m_HeapPositions.push_back(static_cast<std::uint32_t>(m_Heap.size()));
+		m_Heap.push_back(id);
+		SiftUp(m_Heap.size() - 1);
+		return;
+	}
+
+	// the value replaces the one with the lowest count (reusing its node and the memory of its string)
+	const auto id = m_Heap.front();
+	auto& counter = m_Counters[id];
+	auto node = m_Ids.extract(counter.value);
+	counter.value.assign(value);
+	counter.error = counter.count;
+	counter.count += weight;
+	node.key() = counter.value;
+	m_Ids.insert(std::move(node));
+	SiftDown(0);
+}
+
+void FrequentValues::Decay() noexcept
+{
+	// halving keeps the order of the counts, so the heap stays valid
+	for (auto& counter : m_Counters) {
+		counter.count /= 2;
+		counter.error /= 2;
+	}
+}
+
+std::vector<FrequentValues::Counter> FrequentValues::Top(std::size_t count) const
+{
+	auto ids = std::vector<std::uint32_t>(m_Counters.size());
+	std::iota(ids.begin(), ids.end(), 0);
+	count = std::min(count, ids.size());
+	std::ranges::partial_sort(ids, ids.begin() + count, std::greater<>{}, [this](std::uint32_t id) { return m_Counters[id].count; });
+
+	auto top = std::vector<Counter>{};
+	top.reserve(count);
+	for (std::size_t i = 0; i < count; i++)
+		top.push_back(m_Counters[ids[i]]);
+
+	return top;
+}
+
+void FrequentValues::SiftUp(std::size_t pos) noexcept
+{
+	while (pos > 0) {
+		const auto parent = (pos - 1) / 2;
+		if (m_Counters[m_Heap[parent]].count <= m_Counters[m_Heap[pos]].count)
+			break;
+
+		Swap(pos, parent);
+		pos = parent;
+	}
+}
+
+void FrequentValues::SiftDown(std::size_t pos) noexcept
+{
+	for (;;) {
+		auto lowest = pos;
+		for (const auto child : { 2 * pos + 1, 2 * pos + 2 }) {
+			if (child < m_Heap.size() && m_Counters[m_Heap[child]].count < m_Counters[m_Heap[lowest]].count)
+				lowest = child;
+		}
+
+		if (lowest == pos)
+			break;
+
+		Swap(pos, lowest);
+		pos = lowest;
+	}
+}
+
+void FrequentValues::Swap(std::size_t lhs, std::size_t rhs) noexcept
+{
+	std::swap(m_Heap[lhs], m_Heap[rhs]);
+	m_HeapPositions[m_Heap[lhs]] = static_cast<std::uint32_t>(lhs);
+	m_HeapPositions[m_Heap[rhs]] = static_cast<std::uint32_t>(rhs);
+}
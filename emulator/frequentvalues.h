@@ -0,0 +1,51 @@
+#pragma once
+#ifndef _GAMESPY_FREQUENTVALUES_H_
+#define _GAMESPY_FREQUENTVALUES_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace gamespy {
+	// approximate counts of the most frequent values of a stream (space-saving):
+	// - at most `capacity` values are counted, a value which is not counted replaces the one with the lowest count
+	//   and inherits its count as error (so count - error is a lower bound of the weight the value was added with)
+	// - the counters form a min-heap by count, so the memory and the cost of Add do not grow with the number of distinct values
+	// Note: not thread-safe
+	class FrequentValues {
+	public:
+		struct Counter {
+			std::string value;
+			std::uint64_t count = 0;
+			std::uint64_t error = 0;
+		};
+
+	private:
+		const std::size_t m_Capacity;
+		std::vector<Counter> m_Counters; // never reallocated, m_Ids refers to their values
+		std::vector<std::uint32_t> m_Heap; // ids of the counters, the lowest count first
+		std::vector<std::uint32_t> m_HeapPositions; // by id
+		std::unordered_map<std::string_view, std::uint32_t> m_Ids;
+
+		void SiftUp(std::size_t pos) noexcept;
+		void SiftDown(std::size_t pos) noexcept;
+		void Swap(std::size_t lhs, std::size_t rhs) noexcept;
+
+	public:
+		explicit FrequentValues(std::size_t capacity);
+
+		std::size_t size() const noexcept { return m_Counters.size(); }
+
+		void Add(const std::string_view& value, std::uint64_t weight = 1);
+
+		// halves all counts, so values which are not added anymore are replaced eventually
+		void Decay() noexcept;
+
+		// up to `count` counters with the highest counts (the highest first)
+		std::vector<Counter> Top(std::size_t count) const;
+	};
+}
+
+#endif
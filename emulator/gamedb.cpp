@@ -1,41 +1,124 @@
 #include "gamedb.h"
+#include "asio.h"
 #include <format>
-#include <regex>
 #include <fstream>
-#include <format>
 #include <utility>
 #include <ranges>
 #include <print>
 #include <ctime>
+#include <algorithm>
+#include <cctype>
 using namespace gamespy;
 
-Game::Game(std::string name, std::string description, std::string secretKey, std::uint16_t queryPort, bool autoParams, std::map<std::string, Param> params)
-	: m_DB{ name, false },
-	m_Name{ std::move(name) }, m_Description{ std::move(description) }, m_SecretKey{ std::move(secretKey) }, m_QueryPort{ queryPort },
-	m_AutoParams{ autoParams }, m_Params { std::move(params) }
-{
-	std::string sql = R"SQL(
-		CREATE TABLE server(
-			__last_update DATETIME DEFAULT (unixepoch()),
-			__public_ip TEXT NOT NULL,
-			__public_port INTEGER NOT NULL)SQL";
-
-	for (const auto& [name, param] : m_Params)
-		sql += std::format(",\n\t\t\t{} {} DEFAULT {}", name, param.type, param.default_value);
-
-	sql += R"SQL(,
-			PRIMARY KEY(__public_ip, __public_port)
-		);
-		CREATE TRIGGER server_last_updated AFTER UPDATE ON server FOR EACH ROW
-		BEGIN
-			UPDATE server SET __last_update=(unixepoch()) WHERE rowid=NEW.rowid;
-		END;
-	)SQL";
-
-	m_DB.exec(sql);
+namespace {
+	// default values are stored like in the SQL schema ('' or 0)
+	std::string_view UnquoteDefaultValue(const std::string_view& value)
+	{
+		if (value.length() >= 2 && value.front() == '\'' && value.back() == '\'')
+			return value.substr(1, value.length() - 2);
+
+		return value;
+	}
+
+	// the configuration files are read with a single read, the parsed values refer to the returned buffer
+	std::string ReadFile(const std::filesystem::path& path)
+	{
+		auto file = std::ifstream{ path, std::ios::in | std::ios::binary };
+		if (!file.is_open())
+			throw std::runtime_error{ std::format("Unable to find file `{}`", path.generic_string()) };
+
+		auto data = std::string(static_cast<std::size_t>(std::filesystem::file_size(path)), '\0');
+		if (!file.read(data.data(), static_cast<std::streamsize>(data.size())))
+			throw std::runtime_error{ std::format("Unable to read file `{}`", path.generic_string()) };
+
+		return data;
+	}
+
+	// calls f(line) for every line without its line break (\n or \r\n) until f returns true
+	template<typename F>
+	void ForEachLine(std::string_view data, F&& f)
+	{
+		while (!data.empty()) {
+			const auto end = std::min(data.find('\n'), data.size());
+			auto line = data.substr(0, end);
+			data.remove_prefix(std::min(end + 1, data.size()));
+			if (line.ends_with('\r'))
+				line.remove_suffix(1);
+
+			if (f(line))
+				return;
+		}
+	}
+
+	// \w+ (or \w* if empty values are allowed)
+	bool IsWord(const std::string_view& value, bool allowEmpty = false) noexcept
+	{
+		return (allowEmpty || !value.empty()) && std::ranges::all_of(value, [](unsigned char c) { return std::isalnum(c) || c == '_'; });
+	}
+
+	// \d*
+	bool IsDigits(const std::string_view& value) noexcept
+	{
+		return std::ranges::all_of(value, [](unsigned char c) { return std::isdigit(c); });
+	}
+
+	std::uint32_t ParseIPv4(const std::string& ip)
+	{
+		boost::system::error_code ec;
+		const auto address = boost::asio::ip::make_address_v4(ip, ec);
+		if (ec)
+			throw std::invalid_argument{ std::format("invalid ip address: {}", ip) };
+
+		return address.to_uint();
+	}
+
+	std::vector<std::string_view> Views(const std::vector<std::string>& values)
+	{
+		return { values.begin(), values.end() };
+	}
+}
+
+struct Game::staged_t {
+	Server server;
+	std::uint32_t ip = 0; // public_ip, parsed when staged
+	std::string tables = {}; // keys and values of the player- and team-tables back to back
+	std::vector<std::uint32_t> ends = {}; // end of every key and value within tables
+	std::array<std::size_t, 4> counts{}; // player keys, player values, team keys, team values
+};
+
+Game::Game(std::string name, std::string description, std::string secretKey, std::uint16_t queryPort, const staging_params_t& staging, bool autoParams, std::map<std::string, Param> params)
+	: m_Name{ std::move(name) }, m_Description{ std::move(description) }, m_SecretKey{ std::move(secretKey) }, m_SecretKeySchedule{ utils::make_key_schedule(m_SecretKey) }, m_QueryPort{ queryPort },
+	m_AutoParams{ autoParams }, m_Params { std::move(params) }, m_Staging{ staging }
+{
+	for (const auto& [name, param] : m_Params) {
+		const auto numeric = param.type == "INTEGER" || param.type == "FLOAT";
+		auto index = param.index;
+		if (index == ServerStore::IndexType::ORDERED && !numeric) {
+			std::println("[{}] ordered index on non-numeric parameter {} ignored", m_Name, name);
+			index = ServerStore::IndexType::NONE;
+		}
+
+		m_Servers.AddColumn(name, UnquoteDefaultValue(param.default_value), numeric, index);
+	}
+
+	m_Unpublished = true;
+	Publish(std::chrono::milliseconds{ 0 });
+
 	std::println("[{}] registered", m_Name);
 }
 
+Game::~Game()
+{
+
+}
+
+Game::PopularValues::PopularValues(std::vector<std::string> values)
+	: values{ values.size() <= MAX_VALUES ? std::move(values) : throw std::overflow_error{ "No more than 254 popular values are allowed!" } },
+	ids{ Views(this->values) }
+{
+
+}
+
 std::string Game::GetMasterServer() const
 {
 	static constexpr auto PRIME = 0x9CCF9319; // same prime is also used to decode cd-keys
@@ -63,241 +146,655 @@ void Game::AddOrUpdateServer(Server& server)
 	if (server.public_ip.empty() || server.public_port == 0)
 		throw std::runtime_error{ "server missing public_ip and/or public_port" };
 
+	const auto ip = ParseIPv4(server.public_ip);
+	auto lock = std::scoped_lock{ m_Mutex };
+	WriteStaged(std::chrono::milliseconds{ 0 });
+	WriteServer(server, ip);
+	Publish(std::max(m_Staging.max_staleness, PUBLISH_INTERVAL));
+}
+
+void Game::WriteServer(Server& server, std::uint32_t ip)
+{
 	BeforeServerAdd(server);
 
-	auto insertSQL = std::string{ "INSERT OR REPLACE INTO server (__public_ip, __public_port" };
-	std::vector<std::string> columnsToAdd;
-	std::vector<std::string_view> valuesToAdd;
-	for (const auto& [key, value] : server.data) {
-		if (!m_Params.contains(key)) {
-			if (m_AutoParams) {
-				if (!IsValidParamName(key))
-					throw std::runtime_error{ std::format("illegal column name: {}", key) };
-				
-				columnsToAdd.push_back(key);
-			}
-			else
+	m_Overflow.clear();
+	if (m_AutoParams) {
+		for (const auto& [key, value] : server.data) {
+			if (m_Params.contains(key))
 				continue;
+
+			if (!IsValidParamName(key))
+				throw std::runtime_error{ std::format("illegal column name: {}", key) };
+
+			auto count = m_OverflowKeys.find(key);
+			if (count == m_OverflowKeys.end()) {
+				if (m_OverflowKeys.size() >= MAX_OVERFLOW_KEYS)
+					continue;
+
+				count = m_OverflowKeys.emplace(key, 0).first;
+			}
+
+			count->second++;
+			m_Overflow.emplace_back(key, value);
+		}
+	}
+
+	// a reference to a popular value is sent as 1 byte instead of 0xFF, the value and its null-terminator
+	if (++m_PopularSamples % POPULAR_VALUES_SAMPLING == 0) {
+		for (const auto& [key, value] : server.data) {
+			if (GetKeyType(key) == KeyType::STRING)
+				m_PopularSketch.Add(value, value.size() + 1);
+		}
+	}
+
+	// like INSERT OR REPLACE: values which were not sent are reset to their default
+	const auto row = m_Servers.Insert(ip, server.public_port);
+	const auto& columns = m_Servers.GetColumns();
+	m_Servers.SetLastUpdate(row, server.last_update == Clock::time_point{} ? Clock::now() : server.last_update);
+	m_Servers.Assign(row, [&](ServerStore::column_t column) -> std::string_view {
+		const auto value = server.data.find(columns[column].name);
+		return value != server.data.end() ? value->second : columns[column].default_value;
+	});
+	m_Servers.SetOverflow(row, m_Overflow);
+	m_Unpublished = true;
+}
+
+void Game::StageServer(Server server,
+	const std::span<const std::string_view>& playerKeys, const std::span<const std::string_view>& playerValues,
+	const std::span<const std::string_view>& teamKeys, const std::span<const std::string_view>& teamValues)
+{
+	if (m_Staging.max_staleness.count() == 0) {
+		AddOrUpdateServer(server);
+		UpdateServerTables(server.public_ip, server.public_port, playerKeys, playerValues, teamKeys, teamValues);
+		return;
+	}
+
+	// invalid heartbeats are rejected right away instead of failing within the batch
+	if (server.public_ip.empty() || server.public_port == 0)
+		throw std::runtime_error{ "server missing public_ip and/or public_port" };
+	const auto ip = ParseIPv4(server.public_ip);
+
+	auto staged = staged_t{ .server = std::move(server), .ip = ip, .counts = { playerKeys.size(), playerValues.size(), teamKeys.size(), teamValues.size() } };
+	const auto tables = { playerKeys, playerValues, teamKeys, teamValues };
+	auto length = std::size_t{ 0 };
+	for (const auto& values : tables) {
+		for (const auto& value : values)
+			length += value.size();
+	}
+
+	staged.tables.reserve(length);
+	staged.ends.reserve(playerKeys.size() + playerValues.size() + teamKeys.size() + teamValues.size());
+	for (const auto& values : tables) {
+		for (const auto& value : values) {
+			staged.tables.append(value);
+			staged.ends.push_back(static_cast<std::uint32_t>(staged.tables.size()));
 		}
-		
-		insertSQL += "," + key;
+	}
+
+	auto full = false;
+	{
+		auto lock = std::scoped_lock{ m_StagingMutex };
+		m_Staged.push_back(std::move(staged));
+		if (m_Staged.size() == 1)
+			m_OldestStaged = Clock::now();
+
+		full = m_Staged.size() >= m_Staging.max_staged;
+	}
+
+	if (full)
+		FlushServers(true);
+}
 
-		valuesToAdd.push_back(value);
+bool Game::FlushServers(bool force)
+{
+	const auto maxAge = force ? std::chrono::milliseconds{ 0 } : m_Staging.flush_interval;
+	{
+		// most calls find nothing to do, those do not need to wait for readers
+		auto lock = std::scoped_lock{ m_StagingMutex };
+		if (m_Staged.empty())
+			return true;
+		if (Clock::now() - m_OldestStaged.load() < maxAge)
+			return false;
 	}
 
-	insertSQL += ") VALUES(?,?";
-	for (std::size_t i = 0, len = valuesToAdd.size(); i < len; i++)
-		insertSQL += ",?";
-	insertSQL += ')';
+	auto lock = std::scoped_lock{ m_Mutex };
+	WriteStaged(maxAge);
+	return true;
+}
 
-	if (m_AutoParams && !columnsToAdd.empty()) {
-		auto columnSQL = std::string{};
-		for (const auto& column : columnsToAdd) {
-			std::println("[gamedb][{}] new column: {}", m_Name, column);
-			columnSQL += std::format("ALTER TABLE server ADD COLUMN {} TEXT DEFAULT '';", column);
+void Game::WriteStaged(const std::chrono::milliseconds& maxAge)
+{
+	{
+		auto lock = std::scoped_lock{ m_StagingMutex };
+		if (m_Staged.empty() || Clock::now() - m_OldestStaged.load() < maxAge)
+			return;
+
+		std::swap(m_Staged, m_Writing);
+		m_OldestStaged = Clock::time_point::max();
+	}
+
+	// the whole batch is written while m_Mutex is locked, so readers never see a part of it
+	auto values = std::vector<std::string_view>{};
+	for (auto& staged : m_Writing) {
+		values.clear();
+		for (std::size_t i = 0, begin = 0; i < staged.ends.size(); begin = staged.ends[i++])
+			values.push_back(std::string_view{ staged.tables }.substr(begin, staged.ends[i] - begin));
+
+		const auto [playerKeys, playerValues, teamKeys, teamValues] = staged.counts;
+		const auto all = std::span<const std::string_view>{ values };
+		try {
+			WriteServer(staged.server, staged.ip);
+			WriteServerTables(staged.server.public_ip, staged.server.public_port,
+				all.subspan(0, playerKeys),
+				all.subspan(playerKeys, playerValues),
+				all.subspan(playerKeys + playerValues, teamKeys),
+				all.subspan(playerKeys + playerValues + teamKeys, teamValues));
 		}
+		catch (std::exception& e) {
+			std::println("[gamedb][{}] heartbeat of {}:{} dropped: {}", m_Name, staged.server.public_ip, staged.server.public_port, e.what());
+		}
+	}
 
-		auto guard = m_DB.set_scoped_authorizer([&](auto action, auto detail1, auto detail2, auto dbName, auto trigger) {
-			using auth_action = sqlite::auth_action;
-			using auth_res = sqlite::auth_res;
-			if (action == auth_action::SQLITE_ALTER_TABLE && (detail1 == "temp" || detail1 == "main") && detail2 == "server")
-				return auth_res::SQLITE_OK;
-			else if (action == auth_action::SQLITE_FUNCTION
-				&& (detail2 == "printf" || detail2 == "substr" || detail2 == "length"))
-				return auth_res::SQLITE_OK;
-			else if (action == auth_action::SQLITE_READ
-				&& (detail1 == "sqlite_temp_master" || detail1 == "sqlite_master")
-				&& (detail2 == "sql" || detail2 == "temp" || detail2 == "name" || detail2 == "type")
-				&& (dbName == "temp" || dbName == "main"))
-				return auth_res::SQLITE_OK;
-			else if (action == auth_action::SQLITE_UPDATE
-				&& (detail1 == "sqlite_temp_master" || detail1 == "sqlite_master")
-				&& detail2 == "sql"
-				&& (dbName == "temp" || dbName == "main"))
-				return auth_res::SQLITE_OK;
-
-			std::println("[gamedb][{}][columns]unauthorized: action({}) detail1({}), detail2({}), db({}), trigger({})", m_Name, std::to_underlying(action), detail1, detail2, dbName, trigger);
-			// this will make the stmt throw an error
-			return sqlite::auth_res::SQLITE_DENY;
-		});
+	m_Writing.clear();
+	Publish(std::max(m_Staging.max_staleness, PUBLISH_INTERVAL));
+}
+
+void Game::Publish(const std::chrono::milliseconds& maxAge)
+{
+	if (!m_Unpublished || Clock::now() - m_PublishedAt.load() < maxAge)
+		return;
 
-		m_DB.exec(columnSQL);
+	m_Unpublished = false;
+	auto snapshot = m_Servers.Publish();
+	m_Snapshot = snapshot.get();
+	m_PublishedAt = Clock::now();
 
-		for (const auto& column : columnsToAdd)
-			m_Params.emplace(column, Param{ .type = "TEXT" });
+	// readers which loaded the previous snapshot before it was replaced might still use it
+	m_Reclaimer.Retire(std::exchange(m_Published, std::move(snapshot)));
+	m_Reclaimer.Reclaim();
+}
+
+void Game::RefreshSnapshot()
+{
+	const auto now = Clock::now();
+	const auto stale = m_Unpublished.load() && now - m_PublishedAt.load() >= m_Staging.max_staleness;
+	if (!stale && now - m_OldestStaged.load() < m_Staging.max_staleness)
+		return;
+
+	// if a writer holds the lock, the current snapshot is read (writers publish once the snapshot is older than PUBLISH_INTERVAL)
+	auto lock = std::unique_lock{ m_Mutex, std::try_to_lock };
+	if (!lock.owns_lock())
+		return;
+
+	WriteStaged(m_Staging.max_staleness);
+	Publish(m_Staging.max_staleness);
+}
+
+std::optional<ServerFilter::ColumnInfo> Game::ResolveColumn(const std::vector<ServerStore::Column>& columns, const std::string_view& name)
+{
+	// column names are case-insensitive within filters (like they were in sql)
+	auto column = std::optional<ServerStore::column_t>{};
+	for (ServerStore::column_t i = 0; !column && i < columns.size(); i++) {
+		if (std::ranges::equal(columns[i].name, name, [](unsigned char lhs, unsigned char rhs) { return std::tolower(lhs) == std::tolower(rhs); }))
+			column = i;
 	}
 
-	auto stmt = sqlite::stmt{ m_DB, insertSQL };
-	stmt.bind_at(1, server.public_ip);
-	stmt.bind_at(2, server.public_port);
+	if (!column)
+		return std::nullopt;
 
-	for (decltype(valuesToAdd)::size_type i = 0, size = valuesToAdd.size(); i < size; i++)
-		stmt.bind_at(i + 3, valuesToAdd[i]);
+	return ServerFilter::ColumnInfo{ .column = *column, .numeric = columns[*column].numbers.has_value() };
+}
 
-	stmt.insert();
+std::expected<std::shared_ptr<const ServerFilter>, ServerFilter::ParseError> Game::GetFilter(const std::string& query)
+{
+	if (query.empty())
+		return nullptr;
+
+	auto lock = std::scoped_lock{ m_FiltersMutex };
+	if (const auto iter = m_Filters.find(query); iter != m_Filters.end())
+		return iter->second;
+
+	// failed filters are not cached, their columns might still be added (auto params)
+	// (snapshots which are read later never have less columns than the one used to compile the filter)
+	RefreshSnapshot();
+	const auto guard = m_Reclaimer.Pin();
+	const auto& columns = m_Snapshot.load()->GetColumns();
+	auto filter = ServerFilter::Compile(query, [&columns](const std::string_view& name) { return ResolveColumn(columns, name); });
+	if (!filter)
+		return std::unexpected(filter.error());
+
+	// clients usually send the same few filters, so the cache is simply dropped once it is full
+	if (m_Filters.size() >= MAX_CACHED_FILTERS)
+		m_Filters.clear();
+
+	return m_Filters.emplace(query, std::make_shared<const ServerFilter>(std::move(*filter))).first->second;
 }
 
-std::vector<Game::Server> Game::GetServers(const std::string& query, const std::vector<std::string>& fields, const std::size_t limit)
+std::vector<Game::Server> Game::GetServers(const ServerFilter* filter, const std::vector<std::string>& fields, const std::size_t limit)
 {
-	auto error = std::string{};
 	auto servers = std::vector<Game::Server>{};
+	ListServers(filter, fields, limit, [&servers](const ListedServer& server) {
+		servers.push_back(server.Materialize());
+	});
 
-	auto sql = std::string{ "SELECT __last_update,__public_ip,__public_port" };
+	return servers;
+}
+
+void Game::ListServers(const ServerFilter* filter, const std::vector<std::string>& fields, const std::size_t limit, const std::function<void(const ListedServer&)>& visit)
+{
+	if (limit == 0)
+		return;
+
+	RefreshSnapshot();
+	const auto guard = m_Reclaimer.Pin();
+	const auto& snapshot = *m_Snapshot.load();
+
+	auto columns = std::vector<std::optional<ServerStore::column_t>>{};
+	columns.reserve(fields.size());
 	for (const auto& field : fields)
-		sql += std::format(",{}", field);
-
-	auto guard = m_DB.set_scoped_authorizer([&](auto action, auto detail1, auto detail2, auto dbName, auto trigger) {
-		using auth_action = sqlite::auth_action;
-		using auth_res = sqlite::auth_res;
-		if (action == auth_action::SQLITE_READ && detail1 == "server" && (dbName == "temp" || dbName == "main"))
-			return auth_res::SQLITE_OK;
-		else if (action == auth_action::SQLITE_SELECT)
-			return auth_res::SQLITE_OK;
-		else if (action == auth_action::SQLITE_FUNCTION && (detail2 == "like"))
-			return auth_res::SQLITE_OK;
-
-		std::println("[gamedb][{}][retrieve]unauthorized: action({}) detail1({}), detail2({}), db({}), trigger({})", m_Name, std::to_underlying(action), detail1, detail2, dbName, trigger);
-		return auth_res::SQLITE_DENY;
-	});
-	
-	sql += " FROM server";
-	if (!query.empty())
-		sql += std::format(" WHERE {}", query);
-
-	sql += std::format(" LIMIT {}", limit);
-
-	auto stmt = sqlite::stmt{ m_DB, sql };
-	while (stmt.query()) {
-		auto lastUpdated = stmt.column_at<std::time_t>(0);
-		Server server{
-			.last_update = Clock::from_time_t(lastUpdated),
-			.public_ip = stmt.column_at<std::string>(1),
-			.public_port = stmt.column_at<std::uint16_t>(2)
-		};
-
-		for (std::size_t i = 0; i < fields.size(); i++)
-			server.data.emplace(fields[i], stmt.column_at<std::string>(i + 3));
-
-		servers.push_back(server);
+		columns.push_back(snapshot.FindColumn(field));
+
+	// whole pages are filtered at once, only the matching rows are visited
+	// (if an index narrows down the candidates, pages without candidates are skipped)
+	const auto candidates = filter ? filter->FindCandidates(snapshot) : std::nullopt;
+	auto count = std::size_t{ 0 };
+	for (std::size_t page = 0; page < snapshot.GetPageCount() && count < limit; page++) {
+		if (candidates && !(*candidates)[page])
+			continue;
+
+		auto rows = filter ? filter->Select(snapshot, page, candidates ? (*candidates)[page] : ~std::uint64_t{ 0 }) : snapshot.GetUsedRows(page);
+		for (; rows && count < limit; rows &= rows - 1, count++) {
+			const auto row = static_cast<ServerStore::row_t>(page * ServerStore::PAGE_SIZE + std::countr_zero(rows));
+			visit(ListedServer{ snapshot, fields, columns, row });
+		}
 	}
+}
 
-	return servers;
+Game::Server Game::ListedServer::Materialize() const
+{
+	auto server = Server{
+		.last_update = m_Snapshot.GetLastUpdate(row),
+		.public_ip = boost::asio::ip::address_v4{ m_Snapshot.GetIP(row) }.to_string(),
+		.public_port = m_Snapshot.GetPort(row)
+	};
+
+	for (std::size_t i = 0; i < m_Fields.size(); i++) {
+		if (m_Columns[i])
+			server.data.emplace(m_Fields[i], m_Snapshot.Get(row, *m_Columns[i]));
+		else if (const auto value = m_Snapshot.FindOverflow(row, m_Fields[i]))
+			server.data.emplace(m_Fields[i], *value);
+	}
+
+	return server;
 }
 
 void Game::CleanupServers(const std::vector<std::pair<std::string, std::uint16_t>>& servers)
 {
-	auto stmt = sqlite::stmt{ m_DB, "DELETE FROM server WHERE __public_ip=? and __public_port=?" };
+	// staged heartbeats must not bring back the servers which are removed
+	auto lock = std::scoped_lock{ m_Mutex };
+	WriteStaged(std::chrono::milliseconds{ 0 });
 	for (const auto& [ip, port] : servers) {
-		stmt.bind(ip, port);
-		stmt.update();
-		stmt.reset();
+		m_Servers.Erase(ParseIPv4(ip), port);
+		m_ServerTables.erase(std::make_pair(ip, port));
 	}
+
+	m_Unpublished = true;
+	Publish(std::max(m_Staging.max_staleness, PUBLISH_INTERVAL));
 }
 
-GameDB::GameDB()
+void Game::UpdateServerTables(const std::string& public_ip, std::uint16_t public_port,
+	const std::span<const std::string_view>& playerKeys, const std::span<const std::string_view>& playerValues,
+	const std::span<const std::string_view>& teamKeys, const std::span<const std::string_view>& teamValues)
 {
+	auto lock = std::scoped_lock{ m_Mutex };
+	WriteStaged(std::chrono::milliseconds{ 0 });
+	WriteServerTables(public_ip, public_port, playerKeys, playerValues, teamKeys, teamValues);
+}
 
+void Game::WriteServerTables(const std::string& public_ip, std::uint16_t public_port,
+	const std::span<const std::string_view>& playerKeys, const std::span<const std::string_view>& playerValues,
+	const std::span<const std::string_view>& teamKeys, const std::span<const std::string_view>& teamValues)
+{
+	const auto intern = [&](const std::string_view& name) -> std::optional<std::uint16_t> {
+		if (const auto iter = m_TableColumnIds.find(name); iter != m_TableColumnIds.end())
+			return iter->second;
+
+		if (m_TableColumnNames.size() >= MAX_TABLE_COLUMN_NAMES)
+			return std::nullopt;
+
+		const auto id = static_cast<std::uint16_t>(m_TableColumnNames.size());
+		m_TableColumnNames.emplace_back(name);
+		m_TableColumnIds.emplace(name, id);
+		return id;
+	};
+
+	auto& tables = m_ServerTables[std::make_pair(public_ip, public_port)];
+	tables.players.Assign(playerKeys, playerValues, intern);
+	tables.teams.Assign(teamKeys, teamValues, intern);
 }
 
-GameDB::~GameDB()
+std::optional<Game::Server> Game::GetServerInfo(const std::string& public_ip, std::uint16_t public_port)
 {
+	const auto ip = ParseIPv4(public_ip);
+	auto lock = std::scoped_lock{ m_Mutex };
+	WriteStaged(m_Staging.max_staleness);
+	const auto row = m_Servers.Find(ip, public_port);
+	if (row == ServerStore::NO_ROW)
+		return std::nullopt;
+
+	auto server = Server{
+		.last_update = m_Servers.GetLastUpdate(row),
+		.public_ip = public_ip,
+		.public_port = public_port
+	};
+
+	const auto addRule = [&](const std::string_view& key, const std::string_view& value) {
+		server.stats.append(key);
+		server.stats.push_back('\0');
+		server.stats.append(value);
+		server.stats.push_back('\0');
+	};
+
+	const auto& columns = m_Servers.GetColumns();
+	for (ServerStore::column_t column = 0; column < columns.size(); column++) {
+		const auto& value = server.data.emplace(columns[column].name, m_Servers.Get(row, column)).first->second;
+		addRule(columns[column].name, value);
+	}
+
+	m_Servers.ForEachOverflow(row, [&](const std::string_view& key, const std::string_view& value) {
+		server.data.emplace(key, value);
+		addRule(key, value);
+	});
+
+	if (const auto tables = m_ServerTables.find(std::make_pair(public_ip, public_port)); tables != m_ServerTables.end()) {
+		for (const auto& table : { &tables->second.players, &tables->second.teams }) {
+			for (std::size_t row = 0; row < table->rows(); row++) {
+				for (std::size_t column = 0; column < table->columns(); column++)
+					addRule(std::format("{}{}", m_TableColumnNames[table->column(column)], row), table->value(row, column));
+			}
+		}
+	}
 
+	return server;
 }
 
-void GameDB::ParseGamesTSV(const std::filesystem::path& path, std::function<bool(const ParsedGame&)> callback)
+void Game::ForEachServer(const std::function<void(const StoredServer&)>& callback)
 {
-	auto gamesFile = std::ifstream{ path, std::ios::in };
-	if (!gamesFile.is_open())
-		throw std::runtime_error{ std::format("Unable to find file `{}`", path.generic_string()) };
+	auto lock = std::scoped_lock{ m_Mutex };
+	WriteStaged(std::chrono::milliseconds{ 0 });
+
+	// the vectors are reused by all servers
+	const auto& columns = m_Servers.GetColumns();
+	auto values = std::vector<std::pair<std::string_view, std::string_view>>{};
+	auto keys = std::array<std::vector<std::string_view>, 2>{};
+	auto tableValues = std::array<std::vector<std::string_view>, 2>{};
+	m_Servers.ForEach([&](ServerStore::row_t row) {
+		values.clear();
+		for (ServerStore::column_t column = 0; column < columns.size(); column++) {
+			if (const auto value = m_Servers.Get(row, column); value != columns[column].default_value)
+				values.emplace_back(columns[column].name, value);
+		}
+		m_Servers.ForEachOverflow(row, [&](const std::string_view& key, const std::string_view& value) { values.emplace_back(key, value); });
+
+		const auto ip = boost::asio::ip::address_v4{ m_Servers.GetIP(row) }.to_string();
+		const auto tables = m_ServerTables.find(std::make_pair(ip, m_Servers.GetPort(row)));
+		for (std::size_t t = 0; t < 2; t++) {
+			keys[t].clear();
+			tableValues[t].clear();
+			if (tables == m_ServerTables.end())
+				continue;
 
-	// FULL-TITLE	GAMENAME	GAMEID	SECRETKEY	STATS_VERSION	STATS_KEY
-	const auto pattern = std::regex{ R"(^(.+)\t(\w+)\t(\d*)\t(\w*)\t(\d*)\t(\w*)$)" };
-	auto match = std::smatch{};
+			// the tables are stored column by column, heartbeats send them row by row
+			const auto& table = t == 0 ? tables->second.players : tables->second.teams;
+			for (std::size_t column = 0; column < table.columns(); column++)
+				keys[t].push_back(m_TableColumnNames[table.column(column)]);
+			for (std::size_t r = 0; r < table.rows(); r++) {
+				for (std::size_t column = 0; column < table.columns(); column++)
+					tableValues[t].push_back(table.value(r, column));
+			}
+		}
 
-	for (std::string line; std::getline(gamesFile, line);) {
-		if (line.starts_with('#') || line.empty())
-			continue;
+		callback(StoredServer{
+			.ip = m_Servers.GetIP(row),
+			.port = m_Servers.GetPort(row),
+			.last_update = m_Servers.GetLastUpdate(row),
+			.values = values,
+			.playerKeys = keys[0],
+			.playerValues = tableValues[0],
+			.teamKeys = keys[1],
+			.teamValues = tableValues[1]
+		});
+		return true;
+	});
+}
 
-		if (std::regex_match(line, match, pattern)) {
-			auto stop = callback(ParsedGame{
-				.name = { line.data() + match.position(2), static_cast<std::size_t>(match.length(2)) },
-				.description = { line.data() + match.position(1), static_cast<std::size_t>(match.length(1)) },
-				.secretKey = { line.data() + match.position(4), static_cast<std::size_t>(match.length(4)) },
-				.queryPort = 6500
-			});
+void Game::PromoteColumns()
+{
+	auto promoted = std::vector<std::pair<std::string, Param>>{};
+	{
+		auto lock = std::scoped_lock{ m_Mutex };
+		WriteStaged(std::chrono::milliseconds{ 0 });
+		for (auto iter = m_OverflowKeys.begin(); iter != m_OverflowKeys.end();) {
+			if (iter->second < PROMOTE_MIN_HEARTBEATS) {
+				++iter;
+				continue;
+			}
 
-			if (stop)
-				return;
+			std::println("[gamedb][{}] new column: {}", m_Name, iter->first);
+			const auto& param = m_Params.emplace(iter->first, Param{ .type = "TEXT", .default_value = "''" }).first->second;
+			m_Servers.AddColumn(iter->first);
+			promoted.emplace_back(iter->first, param);
+			iter = m_OverflowKeys.erase(iter);
 		}
+
+		if (promoted.empty())
+			return;
+
+		m_Unpublished = true;
+		Publish(std::chrono::milliseconds{ 0 });
 	}
+
+	for (const auto& [name, param] : promoted)
+		AfterColumnAdd(name, param);
 }
 
-void GameDB::ParseServerParameters(const std::filesystem::path& path, std::function<bool(const ParsedParameter&)> callback)
+void Game::PublishPopularValues(const Clock::time_point& now, const Clock::duration& interval)
 {
-	auto gamesFile = std::ifstream{ path, std::ios::in };
-	if (!gamesFile.is_open())
-		throw std::runtime_error{ std::format("Unable to find file `{}`", path.generic_string()) };
+	auto top = std::vector<FrequentValues::Counter>{};
+	{
+		auto lock = std::scoped_lock{ m_Mutex };
+		if (now - m_PopularPublished < interval)
+			return;
+
+		m_PopularPublished = now;
+		WriteStaged(std::chrono::milliseconds{ 0 });
+		top = m_PopularSketch.Top(PopularValues::MAX_VALUES);
+		m_PopularSketch.Decay();
+	}
 
-	// GAMEID PARAMETER
-	const auto pattern = std::regex{ R"(^(\w+)\s+(\w+)\s+(\w+)\s+(\S+)$)" };
-	auto match = std::smatch{};
+	auto values = std::vector<std::string>{};
+	for (auto& counter : top) {
+		if (counter.count - counter.error >= POPULAR_MIN_HEARTBEATS * (counter.value.size() + 1))
+			values.push_back(std::move(counter.value));
+	}
+
+	// the ids are positions within the values, so the order of the current dictionary is kept as well
+	auto current = m_PopularValues.load()->values;
+	auto sorted = values;
+	std::ranges::sort(current);
+	std::ranges::sort(sorted);
+	if (sorted == current)
+		return;
+
+	m_PopularValues.store(std::make_shared<const PopularValues>(std::move(values)));
+}
+
+Game::TablesUsage Game::GetServerTablesUsage() const
+{
+	auto lock = std::scoped_lock{ m_Mutex };
+	auto usage = TablesUsage{ .servers = m_ServerTables.size() };
+	for (const auto& [endpoint, tables] : m_ServerTables)
+		usage.bytes += tables.players.GetMemoryUsage() + tables.teams.GetMemoryUsage();
+
+	return usage;
+}
+
+GameDB::GameDB()
+{
+
+}
+
+GameDB::~GameDB()
+{
+
+}
 
-	for (std::string line; std::getline(gamesFile, line);) {
+Game& GameDB::GetGame(const std::string_view& name)
+{
+	const auto game = FindGame(name);
+	if (!game)
+		throw std::out_of_range{ std::format("unknown game {}", name) };
+
+	return *game;
+}
+
+void GameDB::ParseGamesTSV(const std::filesystem::path& path, std::function<bool(const ParsedGame&)> callback)
+{
+	const auto data = ReadFile(path);
+	ParseGamesTSVData(data, std::move(callback));
+}
+
+void GameDB::ParseGamesTSVData(const std::string_view& data, std::function<bool(const ParsedGame&)> callback)
+{
+	ForEachLine(data, [&](const std::string_view& line) {
 		if (line.starts_with('#') || line.empty())
-			continue;
+			return false;
 
-		if (std::regex_match(line, match, pattern)) {
-			auto stop = callback(ParsedParameter{
-				.game = { line.data() + match.position(1), static_cast<std::size_t>(match.length(1)) },
-				.name = { line.data() + match.position(2), static_cast<std::size_t>(match.length(2)) },
-				.type = { line.data() + match.position(3), static_cast<std::size_t>(match.length(3)) },
-				.default_value = { line.data() + match.position(4), static_cast<std::size_t>(match.length(4)) }
-			});
+		// FULL-TITLE	GAMENAME	GAMEID	SECRETKEY	STATS_VERSION	STATS_KEY
+		// (only the title may contain tabs, so the fields are split from the end of the line)
+		auto fields = std::array<std::string_view, 6>{};
+		auto rest = line;
+		for (auto field = fields.size() - 1; field > 0; field--) {
+			const auto tab = rest.rfind('\t');
+			if (tab == std::string_view::npos)
+				return false;
+
+			fields[field] = rest.substr(tab + 1);
+			rest = rest.substr(0, tab);
+		}
+		fields[0] = rest;
 
-			if (stop)
-				return;
+		const auto& [title, name, id, secretKey, statsVersion, statsKey] = fields;
+		if (title.empty() || !IsWord(name) || !IsDigits(id) || !IsWord(secretKey, true) || !IsDigits(statsVersion) || !IsWord(statsKey, true))
+			return false;
+
+		return callback(ParsedGame{
+			.name = name,
+			.description = title,
+			.secretKey = secretKey,
+			.queryPort = 6500
+		});
+	});
+}
+
+void GameDB::ParseServerParameters(const std::filesystem::path& path, std::function<bool(const ParsedParameter&)> callback)
+{
+	const auto data = ReadFile(path);
+	ForEachLine(data, [&](const std::string_view& line) {
+		if (line.starts_with('#') || line.empty())
+			return false;
+
+		// GAMEID PARAMETER TYPE DEFAULT [INDEX]
+		auto fields = std::array<std::string_view, 6>{};
+		auto count = std::size_t{ 0 };
+		for (auto rest = line; count < fields.size();) {
+			const auto begin = rest.find_first_not_of(" \t");
+			if (begin == std::string_view::npos)
+				break;
+
+			rest.remove_prefix(begin);
+			fields[count++] = rest.substr(0, rest.find_first_of(" \t"));
+			rest.remove_prefix(fields[count - 1].size());
 		}
-		else
+
+		const auto& [game, name, type, defaultValue, index, extra] = fields;
+		if (count < 4 || count > 5 || !IsWord(game) || !IsWord(name) || !IsWord(type) || !IsWord(index, true)) {
 			std::println("[GameDB][{}] invalid parameter line: {}", path.string(), line);
-	}
-}
+			return false;
+		}
 
-GameDBSQLite::GameDBSQLite(const params_t& params)
-	: GameDB{}
-{
-	auto games = std::set<std::string>{};
-	auto serverParams = std::map<std::string, std::map<std::string, Game::Param>>{};
-	GameDB::ParseServerParameters(params.game_params_file, [&](const auto& param) {
-		auto game = std::string{ param.game };
-		games.insert(game);
-		serverParams[game].emplace(
-			std::string{ param.name },
-			Game::Param{
-				.type = std::string{ param.type },
-				.default_value = std::string{ param.default_value }
-			}
-		);
-		return false;
+		return callback(ParsedParameter{
+			.game = game,
+			.name = name,
+			.type = type,
+			.default_value = defaultValue,
+			.index = index
+		});
 	});
-	
-	GameDB::ParseGamesTSV(params.games_list_file, [&](const auto& game) {
-		if (games.empty()) return true;
+}
 
-		auto gameName = std::string{ game.name };
-		if (!games.contains(gameName))
+GameDBSQLite::GameDBSQLite(const params_t& params)
+	: GameDB{}, m_AutoParams{ params.auto_params }, m_Staging{ params.staging }, m_AutoParamsFile{ params.auto_params_file }
+{
+	const auto parseParams = [&](const std::filesystem::path& path) {
+		GameDB::ParseServerParameters(path, [&](const auto& param) {
+			auto index = ServerStore::IndexType::NONE;
+			if (param.index == "hash")
+				index = ServerStore::IndexType::HASH;
+			else if (param.index == "ordered")
+				index = ServerStore::IndexType::ORDERED;
+			else if (!param.index.empty())
+				std::println("[GameDB][{}] unknown index type of {}: {}", path.string(), param.name, param.index);
+
+			m_ServerParams[std::string{ param.game }].emplace(
+				std::string{ param.name },
+				Game::Param{
+					.type = std::string{ param.type },
+					.default_value = std::string{ param.default_value },
+					.index = index
+				}
+			);
 			return false;
+		});
+	};
+
+	// the parameters of game_params_file take precedence over the ones which were added automatically
+	parseParams(params.game_params_file);
+	if (params.auto_params && !m_AutoParamsFile.empty() && std::filesystem::exists(m_AutoParamsFile))
+		parseParams(m_AutoParamsFile);
+
+	// the catalog refers to the text of the games list, which is kept (the first entry of a game is used)
+	// Note: titles without a secret key are skipped, their servers can not be validated and their browsers not be encrypted
+	m_GamesList = ReadFile(params.games_list_file);
+	auto names = std::vector<std::string_view>{};
+	auto known = std::set<std::string_view>{};
+	auto withoutKey = std::size_t{ 0 };
+	GameDB::ParseGamesTSVData(m_GamesList, [&](const auto& game) {
+		if (game.secretKey.empty()) {
+			withoutKey++;
+			return false;
+		}
 
-		games.erase(gameName);
-		auto gameParams = serverParams["global"];
-		gameParams.insert_range(serverParams[gameName]);
-
-		m_Games.emplace(
-			std::piecewise_construct,
-			std::forward_as_tuple(game.name),
-			std::forward_as_tuple(std::string{ game.name }, std::string{ game.description }, std::string{ game.secretKey }, game.queryPort, std::ref(params.auto_params), gameParams)
-		);
+		if (known.insert(game.name).second) {
+			m_Games.emplace_back(game);
+			names.push_back(game.name);
+		}
 		return false;
 	});
+	m_GameIds = PerfectHash{ std::move(names) };
+
+	std::println("[GameDB] {} games ({} without secret key skipped)", m_Games.size(), withoutKey);
+}
+
+void GameDBSQLite::SaveAutoParam(const std::string& game, const std::string& name, const Game::Param& param)
+{
+	// the games add their columns from any master server thread
+	auto lock = std::scoped_lock{ m_AutoParamsMutex };
+	auto file = std::ofstream{ m_AutoParamsFile, std::ios::out | std::ios::app };
+	file << std::format("{}\t{}\t{}\t{}\n", game, name, param.type, param.default_value);
+	file.close();
+	if (!file)
+		std::println("[GameDB][{}] unable to save parameter {} of {}", m_AutoParamsFile.string(), name, game);
 }
 
 GameDBSQLite::~GameDBSQLite()
@@ -305,12 +802,40 @@ GameDBSQLite::~GameDBSQLite()
 
 }
 
-bool GameDBSQLite::HasGame(const std::string& name)
+bool GameDBSQLite::HasGame(const std::string_view& name)
 {
-	return m_Games.contains(name);
+	return m_GameIds.Find(name).has_value();
 }
 
-Game& GameDBSQLite::GetGame(const std::string& name)
+Game* GameDBSQLite::FindGame(const std::string_view& name)
 {
-	return m_Games.at(name);
+	const auto id = m_GameIds.Find(name);
+	if (!id)
+		return nullptr;
+
+	auto& entry = m_Games[*id];
+	if (const auto game = entry.game.load(std::memory_order_acquire))
+		return game;
+
+	// created by the first thread which uses the game (heartbeat or browser query)
+	auto lock = std::scoped_lock{ m_CreateMutex };
+	if (const auto game = entry.game.load(std::memory_order_acquire))
+		return game;
+
+	const auto& parsed = entry.parsed;
+	auto gameParams = std::map<std::string, Game::Param>{};
+	for (const auto& paramsOf : { std::string_view{ "global" }, parsed.name }) {
+		if (const auto params = m_ServerParams.find(paramsOf); params != m_ServerParams.end())
+			gameParams.insert(params->second.begin(), params->second.end());
+	}
+
+	entry.owned = std::make_unique<Game>(std::string{ parsed.name }, std::string{ parsed.description }, std::string{ parsed.secretKey }, parsed.queryPort, m_Staging, m_AutoParams, std::move(gameParams));
+	if (m_AutoParams && !m_AutoParamsFile.empty()) {
+		entry.owned->AfterColumnAdd.connect([this, gameName = std::string{ parsed.name }](const std::string& name, const Game::Param& param) {
+			SaveAutoParam(gameName, name, param);
+		});
+	}
+
+	entry.game.store(entry.owned.get(), std::memory_order_release);
+	return entry.owned.get();
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #ifndef _GAMESPY_GAME_DB_H_
 #define _GAMESPY_GAME_DB_H_
 
+#include <algorithm>
 #include <cstdint>
 #include <map>
 #include <string>
@@ -13,13 +14,84 @@
 #include <set>
 #include <chrono>
 #include <array>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <span>
+#include <string_view>
+#include <memory>
+#include <expected>
 #include <boost/signals2/signal.hpp>
 #include "task.h"
-#include "sqlite.h"
+#include "serverstore.h"
+#include "serverfilter.h"
+#include "epoch.h"
+#include "perfecthash.h"
+#include "frequentvalues.h"
+#include "utils.h"
 
 namespace gamespy {
 	using Clock = std::chrono::system_clock;
 
+	// player- or team-table of a server (as reported by its heartbeats), stored column by column:
+	// - the column names are interned by the game, the table only stores their ids
+	// - all values are stored back to back in a single arena which is reused by the next update
+	// Note: rows, columns and values exceeding the limits are dropped, so the memory of a table is bounded
+	class ServerTable {
+	public:
+		static constexpr std::size_t MAX_ROWS = 64;
+		static constexpr std::size_t MAX_COLUMNS = 32;
+		static constexpr std::size_t MAX_ARENA_SIZE = 16 * 1024;
+
+	private:
+		std::vector<std::uint16_t> m_Columns;
+		std::vector<std::uint32_t> m_Offsets; // value of row r and column c: m_Arena[m_Offsets[c * rows + r], m_Offsets[c * rows + r + 1])
+		std::string m_Arena;
+		std::size_t m_Rows = 0;
+
+	public:
+		std::size_t rows() const noexcept { return m_Rows; }
+		std::size_t columns() const noexcept { return m_Columns.size(); }
+		std::uint16_t column(std::size_t column) const noexcept { return m_Columns[column]; }
+		std::string_view value(std::size_t row, std::size_t column) const noexcept
+		{
+			const auto pos = column * m_Rows + row;
+			return std::string_view{ m_Arena }.substr(m_Offsets[pos], m_Offsets[pos + 1] - m_Offsets[pos]);
+		}
+
+		// values are stored row by row (like they are sent by the game server),
+		// intern(key) returns the id of the column name or std::nullopt if the column should be dropped
+		template<typename F>
+		void Assign(const std::span<const std::string_view>& keys, const std::span<const std::string_view>& values, F&& intern)
+		{
+			auto sourceColumns = std::array<std::size_t, MAX_COLUMNS>{};
+			m_Columns.clear();
+			for (std::size_t i = 0; i < keys.size() && m_Columns.size() < MAX_COLUMNS; i++) {
+				if (const auto id = intern(keys[i])) {
+					sourceColumns[m_Columns.size()] = i;
+					m_Columns.push_back(*id);
+				}
+			}
+
+			m_Rows = keys.empty() ? 0 : std::min(values.size() / keys.size(), MAX_ROWS);
+			m_Arena.clear();
+			m_Offsets.clear();
+			m_Offsets.push_back(0);
+			for (std::size_t c = 0; c < m_Columns.size(); c++) {
+				for (std::size_t r = 0; r < m_Rows; r++) {
+					const auto& value = values[r * keys.size() + sourceColumns[c]];
+					m_Arena.append(value.substr(0, MAX_ARENA_SIZE - m_Arena.size()));
+					m_Offsets.push_back(static_cast<std::uint32_t>(m_Arena.size()));
+				}
+			}
+		}
+
+		std::size_t GetMemoryUsage() const noexcept
+		{
+			return sizeof(*this) + m_Columns.capacity() * sizeof(std::uint16_t) + m_Offsets.capacity() * sizeof(std::uint32_t) + m_Arena.capacity();
+		}
+	};
+
 	class Game {
 	public:
 		enum class KeyType {
@@ -28,33 +100,115 @@ namespace gamespy {
 			SHORT = 2
 		};
 
+		// heartbeats are staged and written to the servers in batches (one lock for the whole batch):
+		// - once max_staged heartbeats are staged or when FlushServers is called after the flush interval
+		// - readers publish the staged and written heartbeats first if they exceed max_staleness (and the game is not locked by a writer)
+		struct staging_params_t {
+			const std::chrono::milliseconds max_staleness{ 0 }; // 0: heartbeats are written immediately
+			const std::chrono::milliseconds flush_interval{ 0 };
+			const std::size_t max_staged = 256;
+		};
+
 		struct Param {
 			const std::string type;
 			const std::string default_value;
+			const ServerStore::IndexType index = ServerStore::IndexType::NONE; // secondary index used by browser queries
+		};
+
+		// values which browsers send as their position within the list of popular values (see BrowserClient::PrepareServer),
+		// the dictionary is immutable once it is published
+		struct PopularValues {
+			static constexpr std::size_t MAX_VALUES = 254; // 0xFF marks a value which is sent in full
+
+			const std::vector<std::string> values;
+			const PerfectHash ids; // refers to values
+
+			// throws std::overflow_error if there are more than MAX_VALUES values and std::invalid_argument if they are not distinct
+			explicit PopularValues(std::vector<std::string> values);
+
+			std::optional<std::size_t> Find(const std::string_view& value) const noexcept { return ids.Find(value); }
 		};
 
 	private:
-		sqlite::db m_DB;
+		// the master server may run on multiple threads (shards) which all write to the same game
+		// Note: m_Mutex has to be locked before m_StagingMutex
+		mutable std::mutex m_Mutex;
+		ServerStore m_Servers;
+
+		// browsers read the published snapshot of the servers without locking m_Mutex,
+		// replaced snapshots are deleted once no reader uses them anymore (epoch-based reclamation)
+		// - readers publish the written servers if the snapshot is older than max_staleness and no writer holds the lock
+		// - writers publish once the snapshot is older than max_staleness and PUBLISH_INTERVAL
+		//   (pages which are part of the snapshot are copied on their next write)
+		static constexpr std::chrono::milliseconds PUBLISH_INTERVAL{ 10 };
+		EpochReclaimer m_Reclaimer;
+		std::shared_ptr<const ServerStore::Snapshot> m_Published; // guarded by m_Mutex
+		std::atomic<const ServerStore::Snapshot*> m_Snapshot{ nullptr };
+		std::atomic<Clock::time_point> m_PublishedAt;
+		std::atomic<bool> m_Unpublished{ false }; // servers were written since the snapshot was published
+
+		// compiled filters of browser queries by their text (columns are never removed, so they stay valid)
+		static constexpr std::size_t MAX_CACHED_FILTERS = 256;
+		std::mutex m_FiltersMutex;
+		std::map<std::string, std::shared_ptr<const ServerFilter>, std::less<>> m_Filters;
 		const std::string m_Name;
 		const std::string m_Description;
 		const std::string m_SecretKey;
+		const utils::key_schedule m_SecretKeySchedule; // every challenge is encoded with the secret key, see utils::encode
 		const std::uint16_t m_QueryPort;
 		std::map<std::string, Param> m_Params; // known parameter names
 		const bool m_AutoParams; // automatically add parameters
 
-		// up to 254 most used values (implemented for completeness - was this used to save bandwith?)
-		std::vector<std::string> m_PopularValues;
+		// auto params: unknown keys are stored in the overflow area of the server until PromoteColumns adds them as columns
+		// (adding a column touches every page, so this is done in the background instead of by the heartbeat which sent the key)
+		static constexpr std::size_t MAX_OVERFLOW_KEYS = 256;
+		static constexpr std::size_t PROMOTE_MIN_HEARTBEATS = 16;
+		std::map<std::string, std::size_t, std::less<>> m_OverflowKeys; // number of heartbeats which sent the key
+		std::vector<std::pair<std::string_view, std::string_view>> m_Overflow; // reused by WriteServer
+
+		// the string values of every POPULAR_VALUES_SAMPLING-th written heartbeat are counted by a sketch (weighted by the bytes a reference saves),
+		// PublishPopularValues replaces the dictionary by the values which save the most
+		static constexpr std::size_t POPULAR_VALUES_SKETCH_SIZE = 1024;
+		static constexpr std::size_t POPULAR_VALUES_SAMPLING = 4;
+		static constexpr std::uint64_t POPULAR_MIN_HEARTBEATS = 4; // sampled heartbeats, guaranteed by the sketch
+		FrequentValues m_PopularSketch{ POPULAR_VALUES_SKETCH_SIZE }; // guarded by m_Mutex
+		std::size_t m_PopularSamples = 0; // guarded by m_Mutex
+		Clock::time_point m_PopularPublished; // guarded by m_Mutex (every shard maintains the game, but it is only published once per interval)
+		std::atomic<std::shared_ptr<const PopularValues>> m_PopularValues{ std::make_shared<const PopularValues>(std::vector<std::string>{}) };
 
 		// overrides how key-values are sent to clients (if a key is not present in this map, STRING will be used)
 		std::map<std::string, KeyType> m_KeyTypeOverrides;
 
+		// column names of the player- and team-tables, ids are never reused (so the number of names is limited)
+		static constexpr std::size_t MAX_TABLE_COLUMN_NAMES = 1024;
+		std::vector<std::string> m_TableColumnNames;
+		std::map<std::string, std::uint16_t, std::less<>> m_TableColumnIds;
+
+		struct server_tables_t {
+			ServerTable players;
+			ServerTable teams;
+		};
+		std::map<std::pair<std::string, std::uint16_t>, server_tables_t> m_ServerTables;
+
+		// heartbeat which was not written yet (owns all of its values)
+		struct staged_t;
+		const staging_params_t m_Staging;
+		mutable std::mutex m_StagingMutex;
+		std::vector<staged_t> m_Staged;
+		std::atomic<Clock::time_point> m_OldestStaged{ Clock::time_point::max() }; // max if nothing is staged
+		std::vector<staged_t> m_Writing; // batch which is being written (guarded by m_Mutex, keeps its capacity)
+
+		static std::optional<ServerFilter::ColumnInfo> ResolveColumn(const std::vector<ServerStore::Column>& columns, const std::string_view& name);
+
 	public:
-		Game(std::string name, std::string description, std::string secretKey, std::uint16_t queryPort, bool autoParams = false, std::map<std::string, Param> params = {});
+		Game(std::string name, std::string description, std::string secretKey, std::uint16_t queryPort, const staging_params_t& staging, bool autoParams = false, std::map<std::string, Param> params = {});
+		~Game();
 		std::string GetMasterServer() const; // calculates the designated master server (%s.ms%d.gamespy.com) for this game
 
 		std::string_view GetName()          const noexcept { return m_Name; }
 		std::string_view GetDescription()   const noexcept { return m_Description; }
 		std::string_view GetSecretKey()     const noexcept { return m_SecretKey; }
+		const utils::key_schedule& GetSecretKeySchedule() const noexcept { return m_SecretKeySchedule; }
 		std::uint16_t    GetQueryPort()     const noexcept { return m_QueryPort; }
 
 		static bool IsValidParamName(const std::string& paramName);
@@ -74,24 +228,19 @@ namespace gamespy {
 		}
 
 		// when sending server data via key-value pairs to the clients,
-		// the list of popular-keys is first sent.
-		// they are then used as a references to keys:
-		// instead of sending the full key-string, only the index of the key within the popularKey array is sent
-		// Note: No more than 254 keys must be stored (otherwise runtime overflow-exception will be thrown!)
-		const std::vector<std::string>& GetPopularValues() const noexcept { return m_PopularValues; }
-
-		template<typename R> requires std::ranges::range<R>
-		void SetPopularValues(R&& popularValues)
+		// the list of popular values is sent first.
+		// they are then used as references to values:
+		// instead of sending the full value-string, only the index of the value within the popular value list is sent
+		// Note: the dictionary is replaced by PublishPopularValues, a response keeps using the one it started with
+		std::shared_ptr<const PopularValues> GetPopularValues() const noexcept { return m_PopularValues.load(); }
+		// replaced by the next PublishPopularValues (see PopularValues for the exceptions)
+		void SetPopularValues(std::vector<std::string> popularValues)
 		{
-			if (std::ranges::size(popularValues) > 254)
-				throw std::overflow_error("No more than 254 popular values are allowed!");
-
-			m_PopularValues.clear();
-			m_PopularValues.append_range(popularValues);
+			m_PopularValues.store(std::make_shared<const PopularValues>(std::move(popularValues)));
 		}
 
 		struct Server {
-			std::chrono::time_point<Clock> last_update;
+			std::chrono::time_point<Clock> last_update; // time of the heartbeat (the time it is written if not set)
 			const std::string public_ip;
 			const std::uint16_t public_port;
 			std::string private_ip;
@@ -102,10 +251,95 @@ namespace gamespy {
 		};
 
 		void AddOrUpdateServer(Server& server);
-		std::vector<Server> GetServers(const std::string& query, const std::vector<std::string>& fields, const std::size_t limit);
+
+		// like AddOrUpdateServer and UpdateServerTables, but the heartbeat is only staged (see staging_params_t)
+		void StageServer(Server server,
+			const std::span<const std::string_view>& playerKeys, const std::span<const std::string_view>& playerValues,
+			const std::span<const std::string_view>& teamKeys, const std::span<const std::string_view>& teamValues);
+
+		// writes the staged heartbeats if the oldest one was staged at least flush_interval ago (or force is set),
+		// returns false if heartbeats remain staged
+		bool FlushServers(bool force = false);
+
+		// compiles the filter of a browser query (or returns the cached one), an empty query yields nullptr (matches all servers)
+		std::expected<std::shared_ptr<const ServerFilter>, ServerFilter::ParseError> GetFilter(const std::string& query);
+		// reads the published snapshot (lock-free, heartbeats are visible after at most max_staleness)
+		std::vector<Server> GetServers(const ServerFilter* filter, const std::vector<std::string>& fields, const std::size_t limit);
+
+		// server which matched a browser query, only valid during the callback of ListServers
+		class ListedServer {
+			friend class Game;
+			const ServerStore::Snapshot& m_Snapshot;
+			const std::vector<std::string>& m_Fields;
+			const std::vector<std::optional<ServerStore::column_t>>& m_Columns;
+
+			ListedServer(const ServerStore::Snapshot& snapshot, const std::vector<std::string>& fields, const std::vector<std::optional<ServerStore::column_t>>& columns, ServerStore::row_t row) noexcept
+				: m_Snapshot{ snapshot }, m_Fields{ fields }, m_Columns{ columns }, row{ row }, version{ snapshot.GetVersion(row) } {}
+
+		public:
+			const ServerStore::row_t row;
+			const std::uint64_t version; // changes with every write of the server's values (the row and version identify them within the game)
+
+			// the server with the requested fields
+			Server Materialize() const;
+		};
+		// like GetServers, but the servers are only materialized on demand: visit(server) is called for every matching server (up to limit)
+		void ListServers(const ServerFilter* filter, const std::vector<std::string>& fields, const std::size_t limit, const std::function<void(const ListedServer&)>& visit);
 		void CleanupServers(const std::vector<std::pair<std::string, std::uint16_t>>& servers);
 
+		// player- and team-tables of the last heartbeat (values are stored row by row, see QRHeartbeatPacket)
+		void UpdateServerTables(const std::string& public_ip, std::uint16_t public_port,
+			const std::span<const std::string_view>& playerKeys, const std::span<const std::string_view>& playerValues,
+			const std::span<const std::string_view>& teamKeys, const std::span<const std::string_view>& teamValues);
+
+		// single server with all of its values, the server's "rules" (stats) contain the server values
+		// followed by the player- and team-tables (e.g. player_0, score_0, team_t0) as null-terminated key-value pairs
+		std::optional<Server> GetServerInfo(const std::string& public_ip, std::uint16_t public_port);
+
+		// a stored server with the values which differ from the defaults of their columns and the player- and team-tables
+		// (like they are passed to StageServer), the views are only valid during the callback of ForEachServer
+		struct StoredServer {
+			std::uint32_t ip;
+			std::uint16_t port;
+			Clock::time_point last_update;
+			std::span<const std::pair<std::string_view, std::string_view>> values;
+			std::span<const std::string_view> playerKeys;
+			std::span<const std::string_view> playerValues;
+			std::span<const std::string_view> teamKeys;
+			std::span<const std::string_view> teamValues;
+		};
+
+		// writes the staged heartbeats and calls callback(server) for every server (the game stays locked meanwhile)
+		void ForEachServer(const std::function<void(const StoredServer&)>& callback);
+
+		// adds the overflow keys which were sent by at least PROMOTE_MIN_HEARTBEATS heartbeats as columns
+		void PromoteColumns();
+		// publishes the values of the sketch which save the most bytes and were sent by at least POPULAR_MIN_HEARTBEATS heartbeats,
+		// then decays the sketch (so values which are not sent anymore are replaced)
+		// - does nothing if the values were published less than interval before now (by any shard)
+		// - the current dictionary is kept if the values did not change (the browsers cache the records which refer to it)
+		void PublishPopularValues(const Clock::time_point& now, const Clock::duration& interval);
+
+		struct TablesUsage {
+			std::size_t servers = 0;
+			std::size_t bytes = 0;
+		};
+		TablesUsage GetServerTablesUsage() const;
+
 		boost::signals2::signal<void(Game::Server& server)> BeforeServerAdd;
+		boost::signals2::signal<void(const std::string& name, const Param& param)> AfterColumnAdd; // called by PromoteColumns (not locked)
+
+	private:
+		// require m_Mutex to be locked
+		void WriteServer(Server& server, std::uint32_t ip);
+		void WriteServerTables(const std::string& public_ip, std::uint16_t public_port,
+			const std::span<const std::string_view>& playerKeys, const std::span<const std::string_view>& playerValues,
+			const std::span<const std::string_view>& teamKeys, const std::span<const std::string_view>& teamValues);
+		void WriteStaged(const std::chrono::milliseconds& maxAge); // if the oldest staged heartbeat is at least this old
+		void Publish(const std::chrono::milliseconds& maxAge); // if servers were written and the snapshot is at least this old
+
+		// publishes the written and staged servers if the snapshot is older than max_staleness, but never waits for m_Mutex
+		void RefreshSnapshot();
 	};
 
 	class GameDB
@@ -119,6 +353,8 @@ namespace gamespy {
 			const std::uint16_t queryPort;
 		};
 		static void ParseGamesTSV(const std::filesystem::path& path, std::function<bool(const ParsedGame&)> callback);
+		// like above, but the views of the parsed games refer to `data`
+		static void ParseGamesTSVData(const std::string_view& data, std::function<bool(const ParsedGame&)> callback);
 
 		struct ParsedParameter
 		{
@@ -126,6 +362,7 @@ namespace gamespy {
 			const std::string_view name;
 			const std::string_view type;
 			const std::string_view default_value;
+			const std::string_view index; // optional: hash or ordered
 		};
 		static void ParseServerParameters(const std::filesystem::path& path, std::function<bool(const ParsedParameter&)> callback);
 
@@ -133,27 +370,53 @@ namespace gamespy {
 		GameDB();
 		virtual ~GameDB();
 
-		virtual bool HasGame(const std::string& name) = 0;
-		virtual Game& GetGame(const std::string& name) = 0;
+		// whether the game is known (without creating it)
+		virtual bool HasGame(const std::string_view& name) = 0;
+		// nullptr if the game is unknown, lookups of packet data should use this instead of HasGame followed by GetGame
+		virtual Game* FindGame(const std::string_view& name) = 0;
+		// throws std::out_of_range if the game is unknown
+		Game& GetGame(const std::string_view& name);
 	};
 
 	class GameDBSQLite : public GameDB
 	{
-		std::map<std::string, Game> m_Games;
+		// all titles of the games list, a game (and its server store) is only created once it is used
+		// (most of the titles never send a heartbeat), created games are never removed
+		struct catalog_entry_t {
+			const ParsedGame parsed; // views into m_GamesList
+			std::unique_ptr<Game> owned; // guarded by m_CreateMutex
+			std::atomic<Game*> game{ nullptr };
+		};
+
+		// the catalog is fixed after loading, so the games are looked up through a perfect hash of their names
+		std::string m_GamesList;
+		std::deque<catalog_entry_t> m_Games; // never moved
+		PerfectHash m_GameIds; // position within m_Games by name
+		std::map<std::string, std::map<std::string, Game::Param>, std::less<>> m_ServerParams; // by game name ("global" applies to all games)
+		std::mutex m_CreateMutex;
+		const bool m_AutoParams;
+		const Game::staging_params_t m_Staging;
+
+		// columns added by auto params are appended to auto_params_file (if set), which is read after game_params_file
+		std::mutex m_AutoParamsMutex;
+		const std::filesystem::path m_AutoParamsFile;
+		void SaveAutoParam(const std::string& game, const std::string& name, const Game::Param& param);
 
 		struct params_t
 		{
 			const std::filesystem::path games_list_file;
 			const std::filesystem::path game_params_file;
 			const bool auto_params;
+			const std::filesystem::path auto_params_file;
+			const Game::staging_params_t staging;
 		};
 
 	public:
 		GameDBSQLite(const params_t& params);
 		~GameDBSQLite();
 
-		virtual bool HasGame(const std::string& name) override;
-		virtual Game& GetGame(const std::string& name) override;
+		virtual bool HasGame(const std::string_view& name) override;
+		virtual Game* FindGame(const std::string_view& name) override;
 	};
 }
 #endif
\ No newline at end of file
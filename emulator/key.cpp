@@ -5,8 +5,8 @@
 using namespace gamespy;
 using boost::asio::ip::udp;
 
-CDKeyServer::CDKeyServer(boost::asio::io_context& context)
-	: m_Socket{ context, udp::endpoint{ udp::v4(), PORT } }
+CDKeyServer::CDKeyServer(boost::asio::io_context& context, const params_t& params)
+	: m_Socket{ context, udp::endpoint{ udp::v4(), PORT } }, m_RateLimiter{ params.rate_limit }
 {
 	std::println("[cd-key] starting up: {} UDP", PORT);
 }
@@ -26,6 +26,14 @@ boost::asio::awaitable<void> CDKeyServer::AcceptConnections()
 		if (error || length == 0)
 			continue;
 
+		if (const auto now = RateLimiter::Clock::now(); !m_RateLimiter.Allow(client.address(), now)) {
+			if (now - m_LastDropReport >= DROP_REPORT_INTERVAL) {
+				std::println("[cd-key] rate limiting {}, {} packets dropped so far", client.address().to_string(), m_RateLimiter.GetStats().dropped);
+				m_LastDropReport = now;
+			}
+			continue;
+		}
+
 		auto message = std::span{ buff }.subspan(0, length);
 		utils::gs_xor(message);
 		auto packet = TextPacket::parse(message);
@@ -2,15 +2,26 @@
 #ifndef _GAMESPY_KEY_H_
 #define _GAMESPY_KEY_H_
 #include "asio.h"
+#include "ratelimit.h"
 namespace gamespy {
 	class CDKeyServer
 	{
 		static constexpr std::uint16_t PORT = 29910;
+		static constexpr auto DROP_REPORT_INTERVAL = std::chrono::seconds{ 60 };
 
+	public:
+		struct params_t
+		{
+			const RateLimiter::params_t rate_limit = {};
+		};
+
+	private:
 		boost::asio::ip::udp::socket m_Socket;
+		RateLimiter m_RateLimiter;
+		RateLimiter::Clock::time_point m_LastDropReport;
 
 	public:
-		CDKeyServer(boost::asio::io_context& context);
+		CDKeyServer(boost::asio::io_context& context, const params_t& params);
 		~CDKeyServer();
 
 		boost::asio::awaitable<void> AcceptConnections();
@@ -1,6 +1,7 @@
 #include "playerdb.sqlite.h"
 #include "gamedb.h"
 #include "master.h"
+#include "datagram.h"
 #include "gpcm.h"
 #include "gpsp.h"
 #include "ms.h"
@@ -9,26 +10,138 @@
 #include "asio.h"
 #include "dns.h"
 #include <csignal>
+#include <charconv>
+#include <cmath>
+#include <format>
 #include <print>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace {
+	// number of a name=value argument, nullopt (the error is printed) if the value is not a number
+	template<typename T>
+	std::optional<T> ParseArgument(const std::string_view& arg)
+	{
+		const auto value = arg.substr(arg.find('=') + 1);
+		auto result = T{};
+		const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+		if (ec != std::errc{} || end != value.data() + value.size()) {
+			std::println(std::cerr, "[ERR] invalid argument {}", arg);
+			return std::nullopt;
+		}
+
+		return result;
+	}
+
+	// packets per second, nullopt (the error is printed) if the value is not a number or negative
+	std::optional<double> ParseRate(const std::string_view& arg)
+	{
+		const auto rate = ParseArgument<double>(arg);
+		if (rate && (!std::isfinite(*rate) || *rate < 0.0)) {
+			std::println(std::cerr, "[ERR] invalid rate {} (packets per second, 0 disables the limit)", arg);
+			return std::nullopt;
+		}
+
+		return rate;
+	}
+}
 
 int main(int argc, char **argv)
 {
 	bool startDNS = true, startHTTP = true;
+	std::size_t masterThreads = 1;
+	bool statelessChallenge = false;
+	// packets per second and source ip (0 disables the limit)
+	double masterRate = 200.0, keyRate = 50.0, dnsRate = 100.0;
+	// heartbeats may be written in batches (browsers see them at most this late), 0 writes them immediately
+	auto heartbeatStaleness = std::chrono::milliseconds{ 0 };
+	// validated servers are saved and restored on startup (one file per master server shard)
+	bool warmRestart = true;
+	// identical server list requests share the list for this long (adds to the staleness of heartbeats), 0 disables the cache
+	auto browserListTTL = std::chrono::milliseconds{ 250 };
 	for (int i = 1; i < argc; i++) {
-		if (argv[i] == std::string_view{ "dns=0" })
+		const auto arg = std::string_view{ argv[i] };
+		if (arg == "dns=0")
 			startDNS = false;
-		else if (argv[i] == std::string_view{ "http=0" })
+		else if (arg == "http=0")
 			startHTTP = false;
+		else if (arg.starts_with("master_threads=")) {
+			const auto threads = ParseArgument<std::size_t>(arg);
+			if (!threads)
+				return 1;
+
+			masterThreads = std::max<std::size_t>(1, *threads);
+		}
+		else if (arg == "stateless_challenge=1")
+			statelessChallenge = true;
+		else if (arg.starts_with("master_rate=")) {
+			const auto rate = ParseRate(arg);
+			if (!rate)
+				return 1;
+
+			masterRate = *rate;
+		}
+		else if (arg.starts_with("cdkey_rate=")) {
+			const auto rate = ParseRate(arg);
+			if (!rate)
+				return 1;
+
+			keyRate = *rate;
+		}
+		else if (arg.starts_with("dns_rate=")) {
+			const auto rate = ParseRate(arg);
+			if (!rate)
+				return 1;
+
+			dnsRate = *rate;
+		}
+		else if (arg.starts_with("heartbeat_staleness_ms=")) {
+			const auto staleness = ParseArgument<std::uint32_t>(arg);
+			if (!staleness)
+				return 1;
+
+			heartbeatStaleness = std::chrono::milliseconds{ *staleness };
+		}
+		else if (arg == "warm_restart=0")
+			warmRestart = false;
+		else if (arg.starts_with("browser_list_ttl_ms=")) {
+			const auto ttl = ParseArgument<std::uint32_t>(arg);
+			if (!ttl)
+				return 1;
+
+			browserListTTL = std::chrono::milliseconds{ *ttl };
+		}
+	}
+
+	if (masterThreads > 1 && !gamespy::DatagramSocket::SupportsReusePort()) {
+		std::println("[master] SO_REUSEPORT is not supported, running on a single thread");
+		masterThreads = 1;
 	}
 
 	try {
 		auto context = boost::asio::io_context{};
+		// each additional master server shard runs on its own io_context (and thread)
+		auto masterContexts = std::vector<std::unique_ptr<boost::asio::io_context>>{};
+		for (std::size_t i = 1; i < masterThreads; i++)
+			masterContexts.emplace_back(new boost::asio::io_context{ 1 });
+
+		const auto stopMasters = [&masterContexts]() {
+			for (auto& masterContext : masterContexts)
+				masterContext->stop();
+		};
+
 		auto signals = boost::asio::signal_set{ context, SIGINT, SIGTERM };
 		signals.async_wait([&](auto, auto) {
 			std::println("SHUTDOWN REQUESTED");
 			context.stop();
+			stopMasters();
 		});
 
 		auto playerDB = std::unique_ptr<gamespy::PlayerDB>{ new gamespy::PlayerDBSQLite({
@@ -39,7 +152,9 @@ int main(int argc, char **argv)
 		auto gameDB = std::unique_ptr<gamespy::GameDB>{ new gamespy::GameDBSQLite({
 			 .games_list_file = "game_list.tsv",
 			 .game_params_file = "game_params.cfg",
-			 .auto_params = true
+			 .auto_params = true,
+			 .auto_params_file = "game_params.auto.cfg",
+			 .staging = { .max_staleness = heartbeatStaleness, .flush_interval = std::min(heartbeatStaleness, std::chrono::milliseconds{ 5 }) }
 		}) };
 
 		// commented because this needs to check the bf2-stats authorized servers
@@ -49,21 +164,35 @@ int main(int argc, char **argv)
 		//	});
 		//}
 
-		auto master = gamespy::MasterServer{ context, *gameDB };
+		auto masters = std::vector<std::unique_ptr<gamespy::MasterServer>>{};
+		for (std::size_t i = 0; i < masterThreads; i++) {
+			auto& masterContext = i == 0 ? context : *masterContexts[i - 1];
+			masters.emplace_back(new gamespy::MasterServer{ masterContext, *gameDB, {
+				.shard = i,
+				.shards = masterThreads,
+				.reuse_port = masterThreads > 1,
+				.stateless_challenge = statelessChallenge,
+				.rate_limit = { .rate = masterRate },
+				.registry_file = warmRestart ? std::format("master_registry.{}.bin", i) : std::string{}
+			} });
+		}
+
 		auto gpcm = gamespy::LoginServer{ context, *playerDB };
 		auto gpsp = gamespy::SearchServer{ context, *playerDB };
-		auto ms = gamespy::BrowserServer{ context, *gameDB };
-		auto key = gamespy::CDKeyServer{ context };
+		auto ms = gamespy::BrowserServer{ context, *gameDB, { .cache = { .list_ttl = browserListTTL } } };
+		auto key = gamespy::CDKeyServer{ context, { .rate_limit = { .rate = keyRate } } };
 		std::unique_ptr<gamespy::DNSServer> dns;
 		std::unique_ptr<gamespy::HttpServer> http;
 
 		if (startDNS)
-			dns.reset(new gamespy::DNSServer{ context, *gameDB });
+			dns.reset(new gamespy::DNSServer{ context, *gameDB, { .rate_limit = { .rate = dnsRate } } });
 		
 		if (startHTTP)
 			http.reset(new gamespy::HttpServer{ context, *gameDB });
 
-		boost::asio::co_spawn(context, master.AcceptConnections(), boost::asio::detached);
+		for (std::size_t i = 0; i < masterThreads; i++)
+			boost::asio::co_spawn(i == 0 ? context : *masterContexts[i - 1], masters[i]->AcceptConnections(), boost::asio::detached);
+
 		boost::asio::co_spawn(context, gpcm.AcceptClients(), boost::asio::detached);
 		boost::asio::co_spawn(context, gpsp.AcceptClients(), boost::asio::detached);
 		boost::asio::co_spawn(context, ms.AcceptClients(), boost::asio::detached);
@@ -86,7 +215,29 @@ int main(int argc, char **argv)
 		// http://BF2Web.gamespy.com/ASP/
 		// http://stage-net.gamespy.com/bf2/getplayerinfo.aspx?pid=
 
-		context.run();
+		// an exception on a shard stops the main context, the shards are stopped whenever the main context returns
+		// (otherwise the threads would be joined while their contexts are still running)
+		auto masterThreadPool = std::vector<std::jthread>{};
+		for (auto& masterContext : masterContexts) {
+			masterThreadPool.emplace_back([&masterContext, &context]() {
+				try {
+					masterContext->run();
+				}
+				catch (std::exception& e) {
+					std::println(std::cerr, "[ERR][master] {}", e.what());
+					context.stop();
+				}
+			});
+		}
+
+		try {
+			context.run();
+		}
+		catch (...) {
+			stopMasters();
+			throw;
+		}
+		stopMasters();
 	}
 	catch (std::exception& e) {
 		std::println(std::cerr, "[ERR] {}", e.what());
@@ -2,6 +2,9 @@
 #include "gamedb.h"
 #include "utils.h"
 #include "qr.h"
+#include "registry.h"
+#include <array>
+#include <charconv>
 #include <numeric>
 #include <print>
 #include <span>
@@ -9,20 +12,45 @@
 using namespace gamespy;
 using boost::asio::ip::udp;
 
-MasterServer::MasterServer(boost::asio::io_context& context, GameDB& db)
-	: m_Socket{ context, udp::endpoint{ udp::v4(), PORT } }, m_CleanupTimer{ context }, m_DB {
-	db
+namespace {
+	constexpr auto CHALLENGE_CHARS = std::string_view{ "ABCDEFGHJIKLMNOPQRSTUVWXYZ123456789" };
+	constexpr std::size_t CHALLENGE_LENGTH = 7;
+
+	// the data which the game server has to encode with its secret key
+	// Note: The challenge needs to be even-sized so that the base64 encoding can be generated without padding
+	// This is required because the gamespy encoding is only base64-ish and handles the padding differently than regular base64 encoding
+	constexpr std::size_t CHALLENGE_DATA_LENGTH = CHALLENGE_LENGTH + 2 + 8 + 4;
+	std::string GetChallengeData(const std::string_view& challenge, const udp::endpoint& client)
+	{
+		constexpr std::uint8_t backendOptions = 0;
+		return std::format("{}{:2X}{:8X}{:4X}", challenge, backendOptions, client.address().to_v4().to_uint(), client.port());
+	}
 }
+
+MasterServer::MasterServer(boost::asio::io_context& context, GameDB& db, const params_t& params)
+	: m_Params{ params }, m_Socket{ context, udp::endpoint{ udp::v4(), PORT }, params.reuse_port }, m_RateLimiter{ params.rate_limit }, m_CleanupTimer{ context }, m_DB {
+	db
+}, m_ChallengeSlotKey{ utils::random_key() }
 {
-	std::println("[master] starting up: {} UDP", PORT);
+	std::println("[master] starting up: {} UDP (shard {})", PORT, m_Params.shard);
 	std::println("[master] (%s.available.gamespy.com)");
 	std::println("[master] (master.gamepsy.com)");
 	std::println("[master] (%s.master.gamepsy.com)");
+
+	if (m_Params.stateless_challenge) {
+		std::println("[master] using stateless challenges");
+		m_ChallengedGames.resize(CHALLENGE_SLOTS);
+		RotateChallengeSecret(Clock::now());
+		RotateChallengeSecret(Clock::now());
+	}
+
+	RestoreRegistry();
 }
 
 MasterServer::~MasterServer()
 {
 	std::println("[master] shutting down");
+	m_Registry.reset(); // writes the changes which were not flushed yet
 }
 
 void MasterServer::Cleanup(const boost::system::error_code& ec)
@@ -30,37 +58,339 @@ void MasterServer::Cleanup(const boost::system::error_code& ec)
 	if (ec) return;
 
 	const auto& now = Clock::now();
-	for (auto& servers : std::array{ &m_AwaitingValidation, &m_Validated }) {
-		for (auto i = servers->begin(); i != servers->end(); ) {
-			auto timeSinceLastUpdate = std::chrono::duration_cast<std::chrono::seconds>(now - i->second.last_update);
-			if (timeSinceLastUpdate > std::chrono::seconds{ 60 }) {
-				std::println("[master][server][{}] {}:{} timed out", i->second.gamename, i->first.address().to_string(), i->first.port());
-				m_DB.GetGame(i->second.gamename).CleanupServers({ std::make_pair(i->first.address().to_string(), i->first.port()) });
-				i = servers->erase(i);
-			}
-			else
-				++i;
+	if (now - m_LastStats >= STATS_INTERVAL) {
+		const auto& stats = m_Socket.GetStats();
+		std::println("[master] {} packets in {} wakeups ({:.2f}/wakeup, max {}), {} replies in {} flushes ({:.2f}/flush)",
+			stats.received, stats.wakeups, stats.ReceivedPerWakeup(), stats.max_received,
+			stats.sent, stats.flushes, stats.SentPerFlush());
+		if (stats.dropped)
+			std::println("[master] {} replies dropped because the socket was not writable", stats.dropped);
+		std::println("[master] heartbeats: {} unchanged, {} written", m_HeartbeatStats.unchanged, m_HeartbeatStats.changed);
+		for (const auto& [game, servers] : m_ActiveGames) {
+			const auto usage = game->GetServerTablesUsage();
+			std::println("[master][{}] player and team tables of {} servers: {} bytes", game->GetName(), usage.servers, usage.bytes);
+		}
+		if (m_StaleServers)
+			std::println("[master] {} restored servers did not send a packet since the restart", m_StaleServers);
+		if (m_RateLimiter.IsEnabled())
+			std::println("[master] rate limit: {} packets allowed, {} dropped", m_RateLimiter.GetStats().allowed, m_RateLimiter.GetStats().dropped);
+		m_LastStats = now;
+	}
+
+	if (m_Params.stateless_challenge && now - m_ChallengeSecretRotated >= CHALLENGE_SECRET_LIFETIME)
+		RotateChallengeSecret(now);
+
+	FlushServers(true);
+
+	// keys which games did not know yet are stored in the overflow area of their servers until they are added as columns here,
+	// the popular values which browsers send as references are published here as well
+	if (now - m_GamesMaintained >= GAME_MAINTENANCE_INTERVAL) {
+		for (const auto& [game, servers] : m_ActiveGames) {
+			game->PromoteColumns();
+			game->PublishPopularValues(now, GAME_MAINTENANCE_INTERVAL);
 		}
+		m_GamesMaintained = now;
 	}
 
-	m_CleanupTimer.expires_from_now(std::chrono::seconds{ 60 });
+	if (m_Registry && now - m_RegistryFlushed >= m_Params.registry_interval) {
+		m_Registry->Flush(now);
+		m_RegistryFlushed = now;
+	}
+
+	// only the servers whose timeout is due are visited, the removal from the game is done once per game
+	auto expired = std::map<std::string, std::vector<std::pair<std::string, std::uint16_t>>>{};
+	m_Timeouts.Advance(now, [&](const timeout_t& timeout) {
+		auto servers = &m_AwaitingValidation;
+		auto iter = servers->find(timeout.endpoint);
+		if (iter == servers->end() || iter->second.timeout != timeout.id) {
+			servers = &m_Validated;
+			iter = servers->find(timeout.endpoint);
+		}
+
+		// the server was removed (or replaced) in the meantime
+		if (iter == servers->end() || iter->second.timeout != timeout.id)
+			return;
+
+		const auto deadline = iter->second.last_update + SERVER_TIMEOUT;
+		if (deadline > now) {
+			m_Timeouts.Schedule(deadline, timeout);
+			return;
+		}
+
+		std::println("[master][server][{}] {}:{} timed out", iter->second.gamename, iter->first.address().to_string(), iter->first.port());
+		if (servers == &m_Validated) {
+			expired[iter->second.gamename].emplace_back(iter->first.address().to_string(), iter->first.port());
+			if (iter->second.stale)
+				m_StaleServers--;
+			if (m_Registry)
+				m_Registry->Remove(iter->first.address().to_v4().to_uint(), iter->first.port());
+		}
+
+		servers->erase(iter);
+	});
+
+	for (const auto& [gamename, servers] : expired) {
+		auto& game = m_DB.GetGame(gamename);
+		game.CleanupServers(servers);
+		RemoveActiveServers(game, servers.size());
+	}
+
+	m_CleanupTimer.expires_from_now(CLEANUP_INTERVAL);
 	m_CleanupTimer.async_wait(boost::bind(&MasterServer::Cleanup, this, boost::asio::placeholders::error));
 }
 
-boost::asio::awaitable<void> MasterServer::HandleAvailable(const udp::endpoint& client, QRPacket& packet)
+void MasterServer::ScheduleTimeout(const udp::endpoint& client, server& server)
+{
+	server.timeout = ++m_LastTimeout;
+	m_Timeouts.Schedule(server.last_update + SERVER_TIMEOUT, timeout_t{ .endpoint = client, .id = server.timeout });
+}
+
+void MasterServer::StoreServer(const udp::endpoint& client, const server& validated, Game& game, const QRHeartbeatPacket& packet)
+{
+	const auto now = Clock::now();
+	auto server = Game::Server{
+		.last_update = now,
+		.public_ip = client.address().to_string(),
+		.public_port = client.port(),
+		.data = packet.GetServerValues()
+	};
+	game.StageServer(std::move(server), packet.playerKeys, packet.playerValues, packet.teamKeys, packet.teamValues);
+	m_StagedGames.insert(&game);
+
+	// only the record is serialized here, the registry is written by its own thread
+	if (m_Registry) {
+		m_Registry->Add(RegistryFile::Entry{
+			.gamename = game.GetName(),
+			.instance = validated.instance,
+			.fingerprint = validated.fingerprint,
+			.server = {
+				.ip = client.address().to_v4().to_uint(),
+				.port = client.port(),
+				.last_update = now,
+				.values = packet.server,
+				.playerKeys = packet.playerKeys,
+				.playerValues = packet.playerValues,
+				.teamKeys = packet.teamKeys,
+				.teamValues = packet.teamValues
+			}
+		});
+	}
+}
+
+void MasterServer::FlushServers(bool force)
+{
+	std::erase_if(m_StagedGames, [force](Game* game) { return game->FlushServers(force); });
+}
+
+void MasterServer::RemoveActiveServers(Game& game, std::size_t count)
+{
+	const auto active = m_ActiveGames.find(&game);
+	if (active == m_ActiveGames.end())
+		return;
+
+	if (active->second <= count)
+		m_ActiveGames.erase(active);
+	else
+		active->second -= count;
+}
+
+void MasterServer::RestoreRegistry()
+{
+	if (m_Params.registry_file.empty())
+		return;
+
+	// the file is only replaced by the first flush, which already contains the restored servers
+	const auto start = std::chrono::steady_clock::now();
+	const auto path = m_Params.registry_file.string();
+	const auto registry = RegistryFile::Load(m_Params.registry_file);
+	m_Registry = std::make_unique<RegistryFile::Writer>(m_Params.registry_file, RegistryFile::Header{
+		.shard = static_cast<std::uint32_t>(m_Params.shard),
+		.shards = static_cast<std::uint32_t>(m_Params.shards)
+	});
+	if (!registry) {
+		if (registry.error() != RegistryFile::ParseError::NOT_FOUND)
+			std::println("[master] registry file {} ignored: invalid header", path);
+		return;
+	}
+
+	// the kernel distributes the game servers differently if the number of shards changed
+	const auto& header = registry->GetHeader();
+	const auto now = Clock::now();
+	if (header.shard != m_Params.shard || header.shards != m_Params.shards) {
+		std::println("[master] registry file {} ignored: saved by shard {} of {}", path, header.shard, header.shards);
+		return;
+	}
+
+	if (now - header.saved_at >= SERVER_TIMEOUT) {
+		std::println("[master] registry file {} ignored: saved more than {} seconds ago", path, SERVER_TIMEOUT.count());
+		return;
+	}
+
+	auto restored = std::size_t{ 0 };
+	const auto result = registry->ForEach([&](const RegistryFile::Entry& entry) {
+		auto* const game = m_DB.FindGame(entry.gamename);
+		if (!game)
+			return;
+
+		// restored servers have SERVER_TIMEOUT to send their next packet, the game keeps the time of their last heartbeat
+		const auto client = udp::endpoint{ boost::asio::ip::address_v4{ entry.server.ip }, entry.server.port };
+		const auto [validated, inserted] = m_Validated.try_emplace(client, server{
+			.last_update = now,
+			.instance = entry.instance,
+			.gamename = std::string{ entry.gamename },
+			.fingerprint = entry.fingerprint,
+			.stale = true
+		});
+		if (!inserted)
+			return;
+
+		auto values = std::map<std::string, std::string>{};
+		for (const auto& [key, value] : entry.server.values)
+			values.emplace(key, value);
+
+		try {
+			game->StageServer(Game::Server{
+				.last_update = entry.server.last_update,
+				.public_ip = client.address().to_string(),
+				.public_port = client.port(),
+				.data = std::move(values)
+			}, entry.server.playerKeys, entry.server.playerValues, entry.server.teamKeys, entry.server.teamValues);
+		}
+		catch (std::exception& e) {
+			std::println("[master][server][{}] {}:{} not restored: {}", entry.gamename, client.address().to_string(), client.port(), e.what());
+			m_Validated.erase(validated);
+			return;
+		}
+
+		m_StagedGames.insert(game);
+		m_ActiveGames[game]++;
+		m_StaleServers++;
+		m_Registry->Add(entry);
+		ScheduleTimeout(client, validated->second);
+		restored++;
+	});
+	FlushServers(true);
+
+	if (!result || registry->IsTruncated())
+		std::println("[master] registry file {} is truncated", path);
+
+	std::println("[master] restored {} of {} servers from {} in {} ms", restored, registry->size(), path,
+		std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+void MasterServer::SendChallenge(const udp::endpoint& client, const std::array<std::uint8_t, 4>& instance, const std::string_view& challengeData)
+{
+	std::vector<uint8_t> response;
+	response.push_back(0xFE);
+	response.push_back(0xFD);
+	response.push_back(0x01);
+	response.append_range(instance);
+	response.append_range(challengeData);
+	response.push_back(0);
+
+	m_Socket.Send(client, response);
+}
+
+void MasterServer::SendValidated(const udp::endpoint& client, const std::array<std::uint8_t, 4>& instance)
+{
+	std::vector<std::uint8_t> response;
+	response.push_back(0xFE);
+	response.push_back(0xFD);
+	response.push_back(0x0A);
+	response.append_range(instance);
+
+	m_Socket.Send(client, response);
+}
+
+void MasterServer::RotateChallengeSecret(const Clock::time_point& now)
+{
+	m_ChallengeSecrets[1] = std::move(m_ChallengeSecrets[0]);
+	m_ChallengeSecrets[0] = utils::random_string("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghjklmnopqrstuvwxyz0123456789", 24);
+	m_ChallengeSecretRotated = now;
+}
+
+std::size_t MasterServer::GetChallengeSlot(const udp::endpoint& client, const std::array<std::uint8_t, 4>& instance) const noexcept
+{
+	// keyed, so the slot of another server can not be targeted
+	auto key = std::array<char, 10>{};
+	const auto address = client.address().to_v4().to_bytes();
+	std::ranges::copy(address, key.begin());
+	key[4] = static_cast<char>(client.port() >> 8);
+	key[5] = static_cast<char>(client.port() & 0xFF);
+	std::ranges::copy(instance, key.begin() + 6);
+	return utils::keyed_hash({ key.data(), key.size() }, m_ChallengeSlotKey) % CHALLENGE_SLOTS;
+}
+
+std::string MasterServer::GetStatelessChallenge(const std::string& secret, const udp::endpoint& client, const std::array<std::uint8_t, 4>& instance, const std::string_view& gamename) const
+{
+	auto input = secret;
+	input.append_range(client.address().to_v4().to_bytes());
+	input.push_back(static_cast<char>(client.port() >> 8));
+	input.push_back(static_cast<char>(client.port() & 0xFF));
+	input.append_range(instance);
+	input.append_range(gamename);
+
+	const auto digest = utils::md5(input); // hex string
+	auto challenge = std::string(CHALLENGE_LENGTH, '\0');
+	for (std::size_t i = 0; i < CHALLENGE_LENGTH; i++) {
+		std::uint8_t value = 0;
+		std::from_chars(digest.data() + i * 2, digest.data() + i * 2 + 2, value, 16);
+		challenge[i] = CHALLENGE_CHARS[value % CHALLENGE_CHARS.size()];
+	}
+
+	return challenge;
+}
+
+bool MasterServer::ValidateStatelessChallenge(const udp::endpoint& client, const QRPacket& packet)
+{
+	// the CHALLENGE packet does not contain the gamename, only the game of the last challenge of the server is a candidate
+	auto* const game = m_ChallengedGames[GetChallengeSlot(client, packet.instance)];
+	if (!game)
+		return false;
+
+	const auto proof = packet.str();
+	const auto gamename = game->GetName();
+	std::array<char, utils::base64_length(CHALLENGE_DATA_LENGTH)> encoded;
+	for (const auto& secret : m_ChallengeSecrets) {
+		const auto challengeData = GetChallengeData(GetStatelessChallenge(secret, client, packet.instance, gamename), client);
+		const auto length = utils::encode(game->GetSecretKeySchedule(), challengeData, encoded);
+		if (std::string_view{ encoded.data(), length } != proof)
+			continue;
+
+		// the values are only known (and the server is only visible) after its next heartbeat
+		const auto [validated, inserted] = m_Validated.emplace(client, server{
+			.last_update = Clock::now(),
+			.instance = packet.instance,
+			.gamename = std::string{ gamename }
+		});
+		if (inserted)
+			m_ActiveGames[game]++;
+		ScheduleTimeout(client, validated->second);
+		SendValidated(client, packet.instance);
+		std::println("[master][server][{}] {}:{} validated", gamename, client.address().to_string(), client.port());
+		return true;
+	}
+
+	return false;
+}
+
+void MasterServer::HandleAvailable(const udp::endpoint& client, const QRPacket& packet)
 {
 	// this package is sent by clients and server to check if the gamespy endpoint is running
 	// the response contains a 32-bit status flag which containts only 3 possible status: 0 = available, 1 = unavailable, 2 = temporarily unavailable
 	// sample package: 0x09 0x00 0x00 0x00 0x00 0x62 0x61 0x74 0x74 0x6C 0x65 0x66 0x69 0x65 0x6C 0x64 0x32 0x00
 	//                     |   INSTANCE KEY   |  b    a    t    t    l    e    f    i    e    l    d    2  |
-	if (m_DB.HasGame(std::string{ reinterpret_cast<const char*>(packet.data.data()) }))
-		co_await m_Socket.async_send_to(boost::asio::buffer("\xFE\xFD\x09\0\0\0\0"), client, boost::asio::use_awaitable);
+	static constexpr std::uint8_t available[] = "\xFE\xFD\x09\0\0\0\0";
+	static constexpr std::uint8_t unavailable[] = "\xFE\xFD\x09\0\0\0\1";
+	static constexpr std::uint8_t temporarilyUnavailable[] = "\xFE\xFD\x09\0\0\0\2";
+	if (m_DB.HasGame(packet.str()))
+		m_Socket.Send(client, available);
 	else {
 		constexpr bool permamentlyDisabled = false;
 		if (permamentlyDisabled)
-			co_await m_Socket.async_send_to(boost::asio::buffer("\xFE\xFD\x09\0\0\0\1"), client, boost::asio::use_awaitable);
+			m_Socket.Send(client, unavailable);
 		else
-			co_await m_Socket.async_send_to(boost::asio::buffer("\xFE\xFD\x09\0\0\0\2"), client, boost::asio::use_awaitable);
+			m_Socket.Send(client, temporarilyUnavailable);
 	}
 }
 
@@ -80,145 +410,162 @@ boost::asio::awaitable<void> MasterServer::HandleHeartbeat(const udp::endpoint&
 	//
 	// sample packet:
 	// 0x03 (4-byte instance key)(n-bytes gameserver values: gamename 0x00 battlefield2 0x00 gamever 0x00 1.5....0x00) 0x00
-	if (!packet->server.contains("gamename")) {
+	const auto gamenameValue = packet->GetValue("gamename");
+	if (!gamenameValue) {
 		std::println("[master] received HEARTBEAT with empty gamename");
 		co_return;
 	}
 
-	const auto& gamename = packet->server.at("gamename");
-	if (!m_DB.HasGame(gamename)) {
-		std::println("[master] received HEARTBEAT for unknown game {}", gamename);
+	auto* const found = m_DB.FindGame(*gamenameValue);
+	if (!found) {
+		std::println("[master] received HEARTBEAT for unknown game {}", *gamenameValue);
 		co_return;
 	}
 
-	auto& game = m_DB.GetGame(gamename);
-	if (m_Validated.contains(client)) {
-		auto server = Game::Server{
-			.last_update = Clock::now(),
-			.public_ip = client.address().to_string(),
-			.public_port = client.port(),
-			.data = packet->server
-		};
-		game.AddOrUpdateServer(server);
+	// the packet only references the receive buffer,
+	// its values are only copied (and stored) if they differ from the ones already known
+	auto& game = *found;
+	const auto gamename = game.GetName();
+	const auto fingerprint = packet->GetFingerprint();
+	if (auto validated = m_Validated.find(client); validated != m_Validated.end()) {
+		validated->second.last_update = Clock::now();
+		if (validated->second.stale) {
+			validated->second.stale = false;
+			m_StaleServers--;
+		}
+		if (validated->second.fingerprint == fingerprint) {
+			m_HeartbeatStats.unchanged++;
+			co_return;
+		}
+
+		m_HeartbeatStats.changed++;
+		validated->second.fingerprint = fingerprint;
+		StoreServer(client, validated->second, game, *packet);
+	}
+	else if (m_Params.stateless_challenge) {
+		// nothing is stored until the challenge is answered (heartbeats sent in the meantime receive the same challenge)
+		m_ChallengedGames[GetChallengeSlot(client, packet->instance)] = &game;
+		SendChallenge(client, packet->instance, GetChallengeData(GetStatelessChallenge(m_ChallengeSecrets[0], client, packet->instance, gamename), client));
 	}
 	else if (!m_AwaitingValidation.contains(client)) {
-		// Note: The challenge needs to be even-sized so that the base64 encoding can be generated without padding
-		// This is required because the gamespy encoding is only base64-ish and handles the padding differently than regular base64 encoding
-		constexpr std::uint8_t backendOptions = 0;
-		auto challenge = utils::random_string("ABCDEFGHJIKLMNOPQRSTUVWXYZ123456789", 7);
-		auto responseData = std::format("{}{:2X}{:8X}{:4X}", challenge, backendOptions, client.address().to_v4().to_uint(), client.port());
-
-		std::vector<uint8_t> response;
-		response.push_back(0xFE);
-		response.push_back(0xFD);
-		response.push_back(0x01);
-		response.append_range(packet->instance);
-		response.append_range(responseData);
-		response.push_back(0);
-
-		m_AwaitingValidation.emplace(client, server{ 
+		auto challengeData = GetChallengeData(utils::random_string(std::string{ CHALLENGE_CHARS }, CHALLENGE_LENGTH), client);
+		auto [pending, _] = m_AwaitingValidation.emplace(client, server{ 
 			.last_update = Clock::now(),
-			.proof = utils::encode(game.GetSecretKey(), responseData), 
+			.proof = utils::encode(game.GetSecretKeySchedule(), challengeData), 
 			.instance = packet->instance,
-			.gamename = gamename,
-			.values = packet->server
+			.gamename = std::string{ gamename },
+			.heartbeat = { _packet.data.begin(), _packet.data.end() },
+			.fingerprint = fingerprint
 		});
-		co_await m_Socket.async_send_to(boost::asio::buffer(response), client, boost::asio::use_awaitable);
+		ScheduleTimeout(client, pending->second);
+		SendChallenge(client, packet->instance, challengeData);
 	}
 	else if (m_AwaitingValidation.contains(client)) {
 		auto& server = m_AwaitingValidation.at(client);
 		server.last_update = Clock::now();
-		server.values = packet->server;
+		if (server.fingerprint != fingerprint) {
+			server.heartbeat.assign(_packet.data.begin(), _packet.data.end());
+			server.fingerprint = fingerprint;
+		}
 	}
 }
 
-boost::asio::awaitable<void> MasterServer::HandleKeepAlive(const udp::endpoint& client, QRPacket& packet)
+void MasterServer::HandleKeepAlive(const udp::endpoint& client, const QRPacket& packet)
 {
 	// example packet: 0x08 (4-byte-instance-id) 0x00
 
-	if (m_AwaitingValidation.contains(client))
-		m_AwaitingValidation[client].last_update = Clock::now();
-	else if (m_Validated.contains(client))
-		m_Validated[client].last_update = Clock::now();
+	if (auto iter = m_Validated.find(client); iter != m_Validated.end()) {
+		iter->second.last_update = Clock::now();
+		if (iter->second.stale) {
+			iter->second.stale = false;
+			m_StaleServers--;
+		}
+	}
+	else if (auto iter = m_AwaitingValidation.find(client); iter != m_AwaitingValidation.end())
+		iter->second.last_update = Clock::now();
 	else
 		std::println("[master] received KEEPALIVE for unknown server {}:{}", client.address().to_string(), client.port());
-
-	co_return;
 }
 
 boost::asio::awaitable<void> MasterServer::HandleChallenge(const udp::endpoint& client, QRPacket& packet)
 {
 	auto iter = m_AwaitingValidation.find(client);
 	if (iter != m_AwaitingValidation.end()) {
-		const auto& challenge = std::string{ reinterpret_cast<const char*>(packet.data.data()) };
-		if (iter->second.proof == challenge) {
+		if (iter->second.proof == packet.str()) {
 			// Note: instance is currently ignored
-			m_Validated.emplace(client, iter->second);
+			SendValidated(client, iter->second.instance);
 
-			std::vector<std::uint8_t> response;
-			response.push_back(0xFE);
-			response.push_back(0xFD);
-			response.push_back(0x0A);
-			response.append_range(iter->second.instance);
+			// from now on the values are owned by the game, the fingerprint suffices to detect changes
+			const auto [entry, added] = m_Validated.emplace(client, std::move(iter->second));
+			auto& validated = entry->second;
+			auto& game = m_DB.GetGame(validated.gamename);
+			if (added)
+				m_ActiveGames[&game]++;
 
-			co_await m_Socket.async_send_to(boost::asio::buffer(response), client, boost::asio::use_awaitable);
-
-			auto server = Game::Server{
-				.last_update = iter->second.last_update,
-				.public_ip = client.address().to_string(),
-				.public_port = client.port(),
-				.data = iter->second.values
-			};
-			m_DB.GetGame(iter->second.gamename).AddOrUpdateServer(server);
-			std::println("[master][server][{}] {}:{} added", iter->second.gamename, server.public_ip, server.public_port);
+			const auto heartbeat = std::move(validated.heartbeat);
+			const auto heartbeatPacket = QRHeartbeatPacket::Parse(QRPacket{ .type = QRPacket::Type::HEARTBEAT, .instance = validated.instance, .data = heartbeat });
+			if (heartbeatPacket)
+				StoreServer(client, validated, game, *heartbeatPacket);
+			std::println("[master][server][{}] {}:{} added", validated.gamename, client.address().to_string(), client.port());
 		}
 
 		m_AwaitingValidation.erase(iter);
 	}
+	else if (m_Params.stateless_challenge) {
+		if (!m_Validated.contains(client) && !ValidateStatelessChallenge(client, packet))
+			std::println("[master] received invalid challenge from {}:{}", client.address().to_string(), client.port());
+	}
 	else
 		std::println("[master] received challenge for an unknown server");
+
+	co_return;
 }
 
 boost::asio::awaitable<void> MasterServer::AcceptConnections()
 {
 	Cleanup(boost::system::error_code{});
 
-	std::array<std::uint8_t, 1400> buff;
 	while (m_Socket.is_open()) {
-		udp::endpoint client;
-		const auto [error, length] = co_await m_Socket.async_receive_from(boost::asio::buffer(buff), client, boost::asio::as_tuple(boost::asio::use_awaitable));
-		if (error || length == 0)
-			continue;
-			
-		try {
-			auto packet = QRPacket::Parse(std::span{ buff.data(), length });
-			if (!packet) {
-				std::println("[master] failed to parse packet");
+		const auto datagrams = co_await m_Socket.Receive();
+		const auto received = RateLimiter::Clock::now();
+		for (const auto& [client, data] : datagrams) {
+			if (!m_RateLimiter.Allow(client.address(), received))
 				continue;
-			}
 
-			using Type = QRPacket::Type;
-			switch (packet->type)
-			{
-			case Type::PREQUERY_IP_VERIFY:
-				co_await HandleAvailable(client, *packet);
-				break;
-			case Type::HEARTBEAT:
-				co_await HandleHeartbeat(client, *packet);
-				break;
-			case Type::KEEPALIVE:
-				co_await HandleKeepAlive(client, *packet);
-				break;
-			case Type::CHALLENGE:
-				co_await HandleChallenge(client, *packet);
-				break;
-			default:
-				std::println("[master] Unknown MSG {}", std::to_underlying(packet->type));
+			try {
+				auto packet = QRPacket::Parse(data);
+				if (!packet) {
+					std::println("[master] failed to parse packet");
+					continue;
+				}
+
+				using Type = QRPacket::Type;
+				switch (packet->type)
+				{
+				case Type::PREQUERY_IP_VERIFY:
+					HandleAvailable(client, *packet);
+					break;
+				case Type::HEARTBEAT:
+					co_await HandleHeartbeat(client, *packet);
+					break;
+				case Type::KEEPALIVE:
+					HandleKeepAlive(client, *packet);
+					break;
+				case Type::CHALLENGE:
+					co_await HandleChallenge(client, *packet);
+					break;
+				default:
+					std::println("[master] Unknown MSG {}", std::to_underlying(packet->type));
+				}
+			}
+			catch (std::exception& ex) {
+				std::println("[master] exception: {}", ex.what());
 			}
 		}
-		catch (std::exception& ex) {
-			std::println("[master] exception: {}", ex.what());
-		}
+
+		// all replies of this wakeup (challenges, 0x0A acks, available responses) are sent together,
+		// the next batch is received right away even if the replies could not be sent yet
+		m_Socket.Flush();
+		FlushServers(false);
 	}
-	
 }
@@ -1,15 +1,24 @@
 #pragma once
 #include "gamedb.h"
+#include "datagram.h"
+#include "timingwheel.h"
+#include "ratelimit.h"
+#include "registry.h"
 #include "asio.h"
 #include <array>
 #include <chrono>
+#include <filesystem>
 #include <map>
+#include <memory>
 #include <optional>
+#include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace gamespy {
 	struct QRPacket;
+	struct QRHeartbeatPacket;
 
 	// query and reporting server:
 	// - handles "available" requests (%s.available.gamespy.com)
@@ -17,33 +26,126 @@ namespace gamespy {
 	class MasterServer {
 		static constexpr std::uint16_t PORT = 27900;
 
-		boost::asio::ip::udp::socket m_Socket;
+	public:
+		struct params_t
+		{
+			// multiple master servers (shards) can share the port, each running on its own thread
+			// Note: the kernel distributes the game servers by their source endpoint, so all packets
+			// of one game server are always handled by the same shard
+			const std::size_t shard = 0;
+			const std::size_t shards = 1;
+			const bool reuse_port = false;
+
+			// SYN-cookie like validation: the challenge is derived from a (rotating) secret, the source endpoint,
+			// the instance key and the game, so no state needs to be kept for servers which have not been validated yet
+			const bool stateless_challenge = false;
+
+			// packets of a source ip which exceeds the rate are dropped before they are parsed
+			const RateLimiter::params_t rate_limit = {};
+
+			// warm restart: the changes of the validated servers are appended to the registry file (by a background thread,
+			// flushed periodically and on shutdown) and the servers are restored on startup,
+			// restored servers are stale until their next packet (they time out like any other server)
+			// Note: only a snapshot of the same shard (and number of shards) which is younger than SERVER_TIMEOUT is restored
+			const std::filesystem::path registry_file = {}; // empty: disabled
+			const std::chrono::seconds registry_interval{ 5 }; // the changes are appended by a background thread, so flushing is cheap
+		};
+
+	private:
+		const params_t m_Params;
+		DatagramSocket m_Socket;
+		RateLimiter m_RateLimiter;
 		boost::asio::steady_timer m_CleanupTimer;
 		GameDB& m_DB;
 
+		static constexpr auto SERVER_TIMEOUT = std::chrono::seconds{ 60 };
+		static constexpr auto CLEANUP_INTERVAL = std::chrono::seconds{ 1 };
+		static constexpr auto STATS_INTERVAL = std::chrono::seconds{ 60 };
+		static constexpr auto CHALLENGE_SECRET_LIFETIME = std::chrono::seconds{ 30 };
+		static constexpr auto GAME_MAINTENANCE_INTERVAL = std::chrono::seconds{ 10 }; // see Game::PromoteColumns and Game::PublishPopularValues
+
 		struct server {
-			Clock::time_point last_update;
-			std::string proof;
-			std::array<std::uint8_t, 4> instance;
-			std::string gamename;
-			std::map<std::string, std::string> values;
+			Clock::time_point last_update = {};
+			std::uint64_t timeout = 0; // id of the scheduled timeout (see m_Timeouts)
+			std::string proof = {};
+			std::array<std::uint8_t, 4> instance = {};
+			std::string gamename = {};
+			std::vector<std::uint8_t> heartbeat = {}; // data of the last heartbeat, only kept until the server is validated
+			std::uint64_t fingerprint = 0; // of the last stored values (see QRHeartbeatPacket::GetFingerprint)
+			bool stale = false; // restored from the registry file, no packet was received since the restart
 		};
 
 		std::map<boost::asio::ip::udp::endpoint, server> m_AwaitingValidation;
 		std::map<boost::asio::ip::udp::endpoint, server> m_Validated;
 
+		// number of validated servers by game (updated on validation and on timeout),
+		// the periodic work per game (stats, maintenance) only visits these games instead of all servers
+		std::map<Game*, std::size_t> m_ActiveGames;
+		std::size_t m_StaleServers = 0; // validated servers which are stale (see server::stale)
+
+		// servers are only scheduled once, heartbeats and keepalives just update last_update
+		// and the timeout is rescheduled when it fires too early
+		struct timeout_t {
+			boost::asio::ip::udp::endpoint endpoint;
+			std::uint64_t id;
+		};
+		TimingWheel<timeout_t, Clock> m_Timeouts{ CLEANUP_INTERVAL };
+		std::uint64_t m_LastTimeout = 0;
+		Clock::time_point m_LastStats = Clock::now();
+		Clock::time_point m_GamesMaintained = Clock::now();
+
+		// stateless challenge: challenges of the current and the previous secret are accepted,
+		// the CHALLENGE packet does not contain the game, so the game of the last challenge is kept in a fixed table
+		// by a keyed hash of the endpoint and the instance (see GetChallengeSlot) and the proof is only verified for it
+		// Note: an overwritten slot (or a spoofed heartbeat) only fails the validation, the server is challenged again by its next heartbeat
+		static constexpr std::size_t CHALLENGE_SLOTS = 1 << 16;
+		std::array<std::string, 2> m_ChallengeSecrets;
+		Clock::time_point m_ChallengeSecretRotated;
+		std::vector<Game*> m_ChallengedGames; // CHALLENGE_SLOTS entries (only if stateless_challenge is set)
+		const std::uint64_t m_ChallengeSlotKey;
+
+		// heartbeats of validated servers, only changed ones are written to the game
+		struct heartbeat_stats_t {
+			std::uint64_t unchanged = 0;
+			std::uint64_t changed = 0;
+		} m_HeartbeatStats;
+
+		std::unique_ptr<RegistryFile::Writer> m_Registry; // only if registry_file is set
+		Clock::time_point m_RegistryFlushed = Clock::now();
+
+		// games with staged heartbeats, which are written after the batch of datagrams (see Game::StageServer)
+		std::set<Game*> m_StagedGames;
+
 	public:
-		MasterServer(boost::asio::io_context& context, GameDB& db);
+		MasterServer(boost::asio::io_context& context, GameDB& db, const params_t& params);
 		~MasterServer();
 
 		boost::asio::awaitable<void> AcceptConnections();
 
-		boost::asio::awaitable<void> HandleAvailable(const boost::asio::ip::udp::endpoint& client, QRPacket& packet);
+		// the most frequent packets are handled synchronously (no coroutine frame, no allocation)
+		void HandleAvailable(const boost::asio::ip::udp::endpoint& client, const QRPacket& packet);
+		void HandleKeepAlive(const boost::asio::ip::udp::endpoint& client, const QRPacket& packet);
+
 		boost::asio::awaitable<void> HandleHeartbeat(const boost::asio::ip::udp::endpoint& client, QRPacket& packet);
-		boost::asio::awaitable<void> HandleKeepAlive(const boost::asio::ip::udp::endpoint& client, QRPacket& packet);
 		boost::asio::awaitable<void> HandleChallenge(const boost::asio::ip::udp::endpoint& client, QRPacket& packet);
 
 	private:
 		void Cleanup(const boost::system::error_code& ec);
+		void ScheduleTimeout(const boost::asio::ip::udp::endpoint& client, server& server);
+		void FlushServers(bool force);
+		void RemoveActiveServers(Game& game, std::size_t count);
+
+		void RestoreRegistry();
+
+		// stages the server values and the player- and team-tables of the heartbeat at the game (and adds them to the registry)
+		void StoreServer(const boost::asio::ip::udp::endpoint& client, const server& validated, Game& game, const QRHeartbeatPacket& packet);
+
+		void SendChallenge(const boost::asio::ip::udp::endpoint& client, const std::array<std::uint8_t, 4>& instance, const std::string_view& challengeData);
+		void SendValidated(const boost::asio::ip::udp::endpoint& client, const std::array<std::uint8_t, 4>& instance);
+
+		void RotateChallengeSecret(const Clock::time_point& now);
+		std::size_t GetChallengeSlot(const boost::asio::ip::udp::endpoint& client, const std::array<std::uint8_t, 4>& instance) const noexcept;
+		std::string GetStatelessChallenge(const std::string& secret, const boost::asio::ip::udp::endpoint& client, const std::array<std::uint8_t, 4>& instance, const std::string_view& gamename) const;
+		bool ValidateStatelessChallenge(const boost::asio::ip::udp::endpoint& client, const QRPacket& packet);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "ms.cache.h"
+#include <algorithm>
+using namespace gamespy;
+
+BrowserCache::BrowserCache(const params_t& params)
+	: m_ListTTL{ params.list_ttl }
+{
+
+}
+
+const std::vector<std::uint8_t>& BrowserCache::Records::Store(ServerStore::row_t row, std::uint64_t version, std::vector<std::uint8_t> record)
+{
+	if (row >= m_Versions.size()) {
+		m_Versions.resize(row + 1);
+		m_Records.resize(row + 1);
+	}
+
+	m_Versions[row] = version;
+	m_Records[row] = std::move(record);
+	return m_Records[row];
+}
+
+BrowserCache::Records& BrowserCache::GetRecords(const Game& game, const std::vector<std::string>& fields)
+{
+	// names can not contain null characters
+	auto key = std::string{ game.GetName() };
+	for (const auto& field : fields) {
+		key.push_back('\0');
+		key.append(field);
+	}
+
+	auto found = m_Records.find(key);
+	if (found == m_Records.end()) {
+		if (m_Records.size() >= MAX_FIELD_LISTS)
+			m_Records.erase(std::ranges::min_element(m_Records, {}, [](const auto& records) { return records.second.m_LastUsed; }));
+
+		found = m_Records.emplace(std::move(key), Records{}).first;
+	}
+
+	auto& records = found->second;
+	records.m_LastUsed = ++m_Uses;
+	if (auto popularValues = game.GetPopularValues(); popularValues != records.m_PopularValues) {
+		records.m_PopularValues = std::move(popularValues);
+		records.m_Versions.clear();
+		records.m_Records.clear();
+	}
+
+	return records;
+}
+
+std::shared_ptr<const BrowserCache::ServerList> BrowserCache::FindList(const std::string& key, const Clock::time_point& now)
+{
+	const auto found = m_Lists.find(key);
+	if (found == m_Lists.end())
+		return nullptr;
+
+	if (found->second.expires <= now) {
+		m_Lists.erase(found);
+		return nullptr;
+	}
+
+	return found->second.list;
+}
+
+void BrowserCache::StoreList(std::string key, std::shared_ptr<const ServerList> list, const Clock::time_point& now)
+{
+	if (m_ListTTL.count() == 0)
+		return;
+
+	if (m_Lists.size() >= MAX_LISTS) {
+		std::erase_if(m_Lists, [&now](const auto& cached) { return cached.second.expires <= now; });
+		if (m_Lists.size() >= MAX_LISTS)
+			return;
+	}
+
+	m_Lists.insert_or_assign(std::move(key), cached_list_t{ .expires = now + m_ListTTL, .list = std::move(list) });
+}
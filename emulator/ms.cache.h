@@ -0,0 +1,84 @@
+#pragma once
+#ifndef _GAMESPY_MS_CACHE_H_
+#define _GAMESPY_MS_CACHE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "gamedb.h"
+
+namespace gamespy {
+	// encoded servers of the server lists (see BrowserClient::PrepareServer), shared by all browser clients:
+	// - records are cached per game and field list (the browsers of a game almost always request the same fields)
+	// - a record is reused until the server is written again (the row and version of the server identify its values)
+	// - records refer to the game's popular values by their id, so they are dropped once the game publishes other popular values
+	// - whole server lists are cached for list_ttl by their request (many browsers request the same list when they are opened),
+	//   lists are prepared without suspending the browser server, so identical requests which arrive meanwhile wait for and share that list
+	// Note: not thread-safe, the browser server runs on a single io thread
+	class BrowserCache {
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		struct params_t
+		{
+			const std::chrono::milliseconds list_ttl{ 250 }; // 0 disables the cache of server lists (records are always cached)
+		};
+
+		static constexpr std::size_t MAX_FIELD_LISTS = 64; // the records of the least recently used field list are dropped
+		static constexpr std::size_t MAX_LISTS = 256; // lists are not cached while this many lists did not expire yet
+
+		// encoded server list, the header is prepared for every client (it contains the client's address)
+		struct ServerList {
+			std::shared_ptr<const Game::PopularValues> dictionary; // the popular values refer to it
+			std::vector<std::string_view> popular_values; // sent in the header
+			std::vector<std::uint8_t> servers; // followed by the end of the list, not encrypted
+		};
+
+		class Records {
+			friend class BrowserCache;
+			std::shared_ptr<const Game::PopularValues> m_PopularValues;
+			std::vector<std::uint64_t> m_Versions; // by row, 0 if there is no record (versions start at 1)
+			std::vector<std::vector<std::uint8_t>> m_Records; // by row
+			std::uint64_t m_LastUsed = 0;
+
+		public:
+			// the popular values which the records refer to
+			const std::shared_ptr<const Game::PopularValues>& GetPopularValues() const noexcept { return m_PopularValues; }
+
+			const std::vector<std::uint8_t>* Find(ServerStore::row_t row, std::uint64_t version) const noexcept
+			{
+				return row < m_Versions.size() && m_Versions[row] == version ? &m_Records[row] : nullptr;
+			}
+
+			// replaces the record of the row
+			const std::vector<std::uint8_t>& Store(ServerStore::row_t row, std::uint64_t version, std::vector<std::uint8_t> record);
+		};
+
+	private:
+		std::unordered_map<std::string, Records> m_Records; // by game and field list
+		std::uint64_t m_Uses = 0;
+
+		struct cached_list_t {
+			Clock::time_point expires;
+			std::shared_ptr<const ServerList> list;
+		};
+		const std::chrono::milliseconds m_ListTTL;
+		std::unordered_map<std::string, cached_list_t> m_Lists; // by request (see BrowserClient::GetServerListKey)
+
+	public:
+		BrowserCache(const params_t& params);
+
+		// records of the field list of the game, which refer to its current popular values
+		Records& GetRecords(const Game& game, const std::vector<std::string>& fields);
+
+		// nullptr if the list is not cached or expired
+		std::shared_ptr<const ServerList> FindList(const std::string& key, const Clock::time_point& now = Clock::now());
+		void StoreList(std::string key, std::shared_ptr<const ServerList> list, const Clock::time_point& now = Clock::now());
+	};
+}
+
+#endif
@@ -6,8 +6,8 @@
 #include <print>
 using namespace gamespy;
 
-BrowserClient::BrowserClient(boost::asio::ip::tcp::socket socket, GameDB& db)
-	: m_Socket(std::move(socket)), m_DB(db)
+BrowserClient::BrowserClient(boost::asio::ip::tcp::socket socket, GameDB& db, BrowserCache& cache)
+	: m_Socket(std::move(socket)), m_DB(db), m_Cache(cache)
 {
 
 }
@@ -78,6 +78,9 @@ boost::asio::awaitable<void> BrowserClient::Process()
 		case RequestType::SERVER_LIST_REQUEST:
 			co_await HandleServerListRequest(packet.subspan(3));
 			break;
+		case RequestType::SERVER_INFO_REQUEST:
+			co_await HandleServerInfoRequest(packet.subspan(3));
+			break;
 		default:
 			std::println("[browser] received unknown packet {:2X}", packet[2]);
 		}
@@ -95,42 +98,149 @@ boost::asio::awaitable<void> BrowserClient::HandleServerListRequest(const std::s
 		co_return;
 	}
 
-	if (!m_DB.HasGame(request->toGame)) {
+	auto* const found = m_DB.FindGame(request->toGame);
+	if (!found) {
 		m_Socket.close();
 		std::println("[browser] unknown game {}", request->toGame);
 		co_return;
 	}
 
-	auto& game = m_DB.GetGame(request->toGame);
+	auto& game = *found;
+	const auto filter = game.GetFilter(request->serverFilter);
+	if (!filter) {
+		m_Socket.close();
+		std::println("[browser] invalid server filter ({}): {}", std::to_underlying(filter.error()), request->serverFilter);
+		co_return;
+	}
+
 	co_await StartEncryption(request->challenge, game);
+	m_ServerListRequest = *request;
+
+	// identical requests within the ttl of the cache share the list, only its encryption is done per client
+	const auto sendServers = !(request->options & ServerListRequest::Options::NO_SERVER_LIST) && game.GetQueryPort() != 0xFFFF;
+	if (!sendServers) {
+		auto header = PrepareServerListHeader(game, *request, {});
+		m_Cypher->encrypt(header);
+		co_await m_Socket.async_send(boost::asio::buffer(header), boost::asio::use_awaitable);
+		co_return;
+	}
+
+	auto key = GetServerListKey(*request);
+	auto list = m_Cache.FindList(key);
+	if (!list) {
+		list = PrepareServerList(game, filter->get(), *request);
+		m_Cache.StoreList(std::move(key), list);
+	}
 
-	auto header = PrepareServerListHeader(game, *request);
-	m_Cypher->encrypt(header);
+	// the header and the servers are encrypted as one stream
+	auto header = PrepareServerListHeader(game, *request, list->popular_values);
+	auto serverData = list->servers;
+	m_Cypher->encrypt(std::array{ std::span<std::uint8_t>{ header }, std::span<std::uint8_t>{ serverData } });
 	co_await m_Socket.async_send(boost::asio::buffer(header), boost::asio::use_awaitable);
 
-	if (request->options & ServerListRequest::Options::NO_SERVER_LIST || game.GetQueryPort() == 0xFFFF)
-		co_return;
-	
-	std::uint16_t limit = 500;
-	if (request->limitResultCount)
-		limit = std::min(static_cast<std::uint16_t>(*request->limitResultCount), limit);
-	
-	constexpr bool usePopularFields = true;
-	std::vector<std::uint8_t> serverData;
-	for (const auto& server: game.GetServers(request->serverFilter, request->fieldList, limit))
-		serverData.append_range(PrepareServer(game, server, *request, usePopularFields));
-	
 	// Note: Server Data must be sent in one go because unfortunately there is a bug in the standard
 	// gamespy implementation:
 	// ServerBrowserThink > SBListThink > ProcessIncomingData > CanReceiveOnSocket will not return 
 	// true ever again and this way the client will never actually parse the "last server marker" and 
 	// therefore never perform a cleanup
-	serverData.append_range(std::array{ 0x00, 0xFF, 0xFF, 0xFF, 0xFF });
-	m_Cypher->encrypt(serverData);
 	co_await m_Socket.async_send(boost::asio::buffer(serverData), boost::asio::use_awaitable);
 }
 
-std::vector<std::uint8_t> BrowserClient::PrepareServerListHeader(const Game& game, const ServerListRequest& request)
+std::string BrowserClient::GetServerListKey(const ServerListRequest& request)
+{
+	// neither names nor the filter contain null characters
+	auto key = request.toGame;
+	key.push_back('\0');
+	key.append(request.serverFilter);
+	key.push_back('\0');
+	for (const auto& field : request.fieldList) {
+		key.append(field);
+		key.push_back('\\');
+	}
+
+	key.push_back('\0');
+	key.append(std::to_string(request.limitResultCount.value_or(0)));
+	return key;
+}
+
+std::shared_ptr<const BrowserCache::ServerList> BrowserClient::PrepareServerList(Game& game, const ServerFilter* filter, const ServerListRequest& request)
+{
+	// the servers are encoded first, the header contains the popular values which they use
+	auto& records = m_Cache.GetRecords(game, request.fieldList);
+	struct listed_t {
+		ServerStore::row_t row;
+		std::uint64_t version;
+		std::optional<Game::Server> server; // only materialized if it is not cached (or the list may be small)
+	};
+	auto listed = std::vector<listed_t>{};
+	std::uint16_t limit = 500;
+	if (request.limitResultCount)
+		limit = std::min(static_cast<std::uint16_t>(*request.limitResultCount), limit);
+
+	game.ListServers(filter, request.fieldList, limit, [&](const Game::ListedServer& server) {
+		auto& entry = listed.emplace_back(server.row, server.version);
+		if (listed.size() <= CACHED_LIST_SIZE || !records.Find(server.row, server.version))
+			entry.server.emplace(server.Materialize());
+	});
+
+	auto popularValues = popular_values_t{};
+	auto list = std::make_shared<BrowserCache::ServerList>();
+	if (listed.size() < CACHED_LIST_SIZE) {
+		auto servers = std::vector<Game::Server>{};
+		for (auto& entry : listed)
+			servers.push_back(std::move(*entry.server));
+
+		popularValues = SelectPopularValues(game, servers, request);
+		for (const auto& server : servers)
+			list->servers.append_range(PrepareServer(game, server, request, &popularValues));
+	}
+	else {
+		popularValues = AllPopularValues(records.GetPopularValues());
+		for (const auto& entry : listed) {
+			const auto* record = records.Find(entry.row, entry.version);
+			if (!record)
+				record = &records.Store(entry.row, entry.version, PrepareServer(game, *entry.server, request, &popularValues));
+
+			list->servers.append_range(*record);
+		}
+	}
+
+	list->servers.append_range(std::array{ 0x00, 0xFF, 0xFF, 0xFF, 0xFF });
+	list->dictionary = std::move(popularValues.dictionary);
+	list->popular_values = std::move(popularValues.values);
+	return list;
+}
+
+boost::asio::awaitable<void> BrowserClient::HandleServerInfoRequest(const std::span<const std::uint8_t>& bytes)
+{
+	// sample packet: (4-byte ip)(2-byte port)
+	// the server is sent with the fields of the preceding SERVER_LIST_REQUEST and all of its rules (including players and teams)
+	if (!m_ServerListRequest || !m_Cypher || bytes.size() < 6) {
+		std::println("[browser] packet of type SERVER_INFO_REQUEST is invalid");
+		co_return;
+	}
+
+	const auto ip = boost::asio::ip::address_v4{ { bytes[0], bytes[1], bytes[2], bytes[3] } }.to_string();
+	const auto port = static_cast<std::uint16_t>((bytes[4] << 8) | bytes[5]);
+	auto& game = m_DB.GetGame(m_ServerListRequest->toGame);
+	const auto server = game.GetServerInfo(ip, port);
+	if (!server) {
+		std::println("[browser] SERVER_INFO_REQUEST for unknown server {}:{}", ip, port);
+		co_return;
+	}
+
+	constexpr std::uint8_t PUSH_SERVER_MESSAGE = 2;
+	auto response = std::vector<std::uint8_t>{ 0, 0, PUSH_SERVER_MESSAGE };
+	response.append_range(PrepareServer(game, *server, *m_ServerListRequest));
+
+	// the message length includes the length itself and the message type
+	response[0] = (response.size() >> 8) & 0xFF;
+	response[1] = (response.size()     ) & 0xFF;
+	m_Cypher->encrypt(response);
+	co_await m_Socket.async_send(boost::asio::buffer(response), boost::asio::use_awaitable);
+}
+
+std::vector<std::uint8_t> BrowserClient::PrepareServerListHeader(const Game& game, const ServerListRequest& request, const std::span<const std::string_view>& popularValues)
 {
 	std::vector<std::uint8_t> response;
 
@@ -160,11 +270,6 @@ std::vector<std::uint8_t> BrowserClient::PrepareServerListHeader(const Game& gam
 		response.push_back(0);
 	}
 
-	// Popular values are not request specific and can be optimized:
-	// They do not need to be generated for every request
-	// (because of this, this function is not the ideal place to add them to the response) 
-	// As they are hardly ever used this is currently not implemented nor optimized via hash-map
-	const auto& popularValues = game.GetPopularValues();
 	response.push_back(popularValues.size() & 0xFF);
 	for (const auto& value : popularValues) {
 		response.append_range(value);
@@ -174,7 +279,52 @@ std::vector<std::uint8_t> BrowserClient::PrepareServerListHeader(const Game& gam
 	return response;
 }
 
-std::vector<std::uint8_t> BrowserClient::PrepareServer(const Game& game, const Game::Server& server, const ServerListRequest& request, bool usePopularValues)
+BrowserClient::popular_values_t BrowserClient::SelectPopularValues(const Game& game, const std::vector<Game::Server>& servers, const ServerListRequest& request)
+{
+	auto popular = popular_values_t{ .dictionary = game.GetPopularValues() };
+	const auto& dictionary = *popular.dictionary;
+	popular.positions.assign(dictionary.values.size(), 0xFF);
+	if (servers.size() < 2 || dictionary.values.empty())
+		return popular;
+
+	// positions are used as counters first (up to 2 occurrences)
+	for (const auto& key : request.fieldList) {
+		if (game.GetKeyType(key) != Game::KeyType::STRING)
+			continue;
+
+		for (const auto& server : servers) {
+			const auto iter = server.data.find(key);
+			const auto id = dictionary.Find(iter != server.data.end() ? std::string_view{ iter->second } : std::string_view{});
+			if (id && popular.positions[*id] != 2)
+				popular.positions[*id] = popular.positions[*id] == 0xFF ? 1 : 2;
+		}
+	}
+
+	for (std::size_t id = 0; id < popular.positions.size(); id++) {
+		if (popular.positions[id] != 2) {
+			popular.positions[id] = 0xFF;
+			continue;
+		}
+
+		popular.positions[id] = static_cast<std::uint8_t>(popular.values.size());
+		popular.values.push_back(dictionary.values[id]);
+	}
+
+	return popular;
+}
+
+BrowserClient::popular_values_t BrowserClient::AllPopularValues(std::shared_ptr<const Game::PopularValues> dictionary)
+{
+	auto popular = popular_values_t{ .dictionary = std::move(dictionary) };
+	for (const auto& value : popular.dictionary->values) {
+		popular.positions.push_back(static_cast<std::uint8_t>(popular.values.size()));
+		popular.values.push_back(value);
+	}
+
+	return popular;
+}
+
+std::vector<std::uint8_t> BrowserClient::PrepareServer(const Game& game, const Game::Server& server, const ServerListRequest& request, const popular_values_t* popularValues)
 {
 	std::vector<std::uint8_t> response;
 	response.push_back(0); // flags
@@ -220,22 +370,22 @@ std::vector<std::uint8_t> BrowserClient::PrepareServer(const Game& game, const G
 		response.append_range(boost::asio::ip::make_address_v4(server.icmp_ip).to_bytes());
 	}
 
-	const auto& popularValues = game.GetPopularValues();
 	if (!server.data.empty())
 		response.front() |= Options::HAS_KEYS;
 
 	using KeyType = Game::KeyType;
 	for (const auto& key : request.fieldList) {
 		KeyType keyType = game.GetKeyType(key);
-		const auto& value = server.data.contains(key) ? server.data.at(key) : std::string{};
+		const auto iter = server.data.find(key);
+		const auto value = iter != server.data.end() ? std::string_view{ iter->second } : std::string_view{};
 		switch (keyType) {
 		case KeyType::STRING:
 		{
 			// instead of pushing the full value we can just add the values's position within the popular value list
-			if (usePopularValues) {
-				auto popularValuePos = std::ranges::find(popularValues, value);
-				if (popularValuePos != popularValues.end()) {
-					response.push_back(std::ranges::distance(popularValuePos, popularValues.end()) & 0xFF);
+			if (popularValues) {
+				const auto id = popularValues->dictionary->Find(value);
+				if (id && popularValues->positions[*id] != 0xFF) {
+					response.push_back(popularValues->positions[*id]);
 					break;
 				}
 			}
@@ -246,11 +396,11 @@ std::vector<std::uint8_t> BrowserClient::PrepareServer(const Game& game, const G
 			break;
 		}
 		case KeyType::BYTE:
-			response.push_back(std::stoi(value) & 0xFF);
+			response.push_back(std::stoi(std::string{ value }) & 0xFF);
 			break;
 		case KeyType::SHORT:
 		{
-			auto keyValue = static_cast<std::uint16_t>(std::stoi(value));
+			auto keyValue = static_cast<std::uint16_t>(std::stoi(std::string{ value }));
 			// Note: Little Endianess is expected
 			response.append_range(std::array{
 				(keyValue >> 8) & 0xFF,
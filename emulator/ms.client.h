@@ -9,6 +9,7 @@
 #include <vector>
 #include <utility>
 #include "gamedb.h"
+#include "ms.cache.h"
 
 namespace gamespy {
 	struct ServerListRequest
@@ -62,13 +63,15 @@ namespace gamespy {
 	class BrowserClient {
 		boost::asio::ip::tcp::socket m_Socket;
 		GameDB& m_DB;
+		BrowserCache& m_Cache;
 		std::optional<sapphire> m_Cypher;
+		std::optional<ServerListRequest> m_ServerListRequest; // game and fields used by the following SERVER_INFO requests
 
 	public:
 		BrowserClient(BrowserClient&& rhs) = default;
 		BrowserClient& operator=(BrowserClient&& rhs) = default;
 
-		BrowserClient(boost::asio::ip::tcp::socket socket, GameDB &db);
+		BrowserClient(boost::asio::ip::tcp::socket socket, GameDB &db, BrowserCache& cache);
 		~BrowserClient();
 
 		boost::asio::awaitable<void> Process();
@@ -77,8 +80,25 @@ namespace gamespy {
 		boost::asio::awaitable<void> StartEncryption(const std::string_view& clientChallenge, const Game& game);
 
 		boost::asio::awaitable<void> HandleServerListRequest(const std::span<const std::uint8_t>& bytes);
-		std::vector<std::uint8_t> PrepareServerListHeader(const Game& game, const ServerListRequest& request);
-		std::vector<std::uint8_t> PrepareServer(const Game& game, const Game::Server& server, const ServerListRequest& request, bool usePopularValues = false);
+		boost::asio::awaitable<void> HandleServerInfoRequest(const std::span<const std::uint8_t>& bytes);
+		// popular values which are sent in the header of a server list:
+		// - lists of less than CACHED_LIST_SIZE servers send the values of the game's dictionary which occur more than once within the list
+		//   (a reference to a value which is sent once saves nothing)
+		// - larger lists send the whole dictionary, so the encoded servers do not depend on the list and are cached (see BrowserCache)
+		static constexpr std::size_t CACHED_LIST_SIZE = 32;
+		struct popular_values_t {
+			std::shared_ptr<const Game::PopularValues> dictionary;
+			std::vector<std::uint8_t> positions = {}; // within the header by id of the dictionary, 0xFF if the value is not sent
+			std::vector<std::string_view> values = {}; // refer to the dictionary
+		};
+		popular_values_t SelectPopularValues(const Game& game, const std::vector<Game::Server>& servers, const ServerListRequest& request);
+		static popular_values_t AllPopularValues(std::shared_ptr<const Game::PopularValues> dictionary);
+
+		// lists are cached by their game, filter, fields and limit (see BrowserCache)
+		static std::string GetServerListKey(const ServerListRequest& request);
+		std::shared_ptr<const BrowserCache::ServerList> PrepareServerList(Game& game, const ServerFilter* filter, const ServerListRequest& request);
+		std::vector<std::uint8_t> PrepareServerListHeader(const Game& game, const ServerListRequest& request, const std::span<const std::string_view>& popularValues);
+		std::vector<std::uint8_t> PrepareServer(const Game& game, const Game::Server& server, const ServerListRequest& request, const popular_values_t* popularValues = nullptr);
 
 	private:
 		BrowserClient() = delete;
@@ -4,8 +4,8 @@
 #include <utility>
 using namespace gamespy;
 
-BrowserServer::BrowserServer(boost::asio::io_context& context, GameDB& db)
-	: m_Acceptor(context, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), PORT)),  m_DB(db)
+BrowserServer::BrowserServer(boost::asio::io_context& context, GameDB& db, const params_t& params)
+	: m_Acceptor(context, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), PORT)),  m_DB(db), m_Cache(params.cache)
 {
 	std::println("[browser] starting up: {} TCP", PORT);
 	std::println("[browser] (%s.ms%d.gamespy.com)");
@@ -27,7 +27,7 @@ boost::asio::awaitable<void> BrowserServer::AcceptClients()
 boost::asio::awaitable<void> BrowserServer::HandleIncoming(boost::asio::ip::tcp::socket socket)
 {
 	try {
-		BrowserClient client(std::move(socket), m_DB);
+		BrowserClient client(std::move(socket), m_DB, m_Cache);
 		co_await client.Process();
 	}
 	catch (std::exception& e) {
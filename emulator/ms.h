@@ -1,16 +1,25 @@
 #pragma once
 #include "asio.h"
+#include "ms.cache.h"
 
 namespace gamespy {
 	class GameDB;
 	class BrowserServer {
+	public:
+		struct params_t
+		{
+			const BrowserCache::params_t cache = {};
+		};
+
+	private:
 		// (legacy "enctype1") runs on 28900 (which is currently not supported and support isn't planned)
 		static constexpr std::uint16_t PORT = 28910; // %s.ms%d.gamespy.com
 		boost::asio::ip::tcp::acceptor m_Acceptor;
 		GameDB& m_DB;
+		BrowserCache m_Cache;
 
 	public:
-		BrowserServer(boost::asio::io_context& context, GameDB& db);
+		BrowserServer(boost::asio::io_context& context, GameDB& db, const params_t& params);
 		~BrowserServer();
 
 		boost::asio::awaitable<void> AcceptClients();
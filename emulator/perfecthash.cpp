@@ -0,0 +1,70 @@
+#include "perfecthash.h"
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+using namespace gamespy;
+
+PerfectHash::PerfectHash()
+	: m_Seeds(1), m_Slots(1, NO_KEY)
+{
+
+}
+
+PerfectHash::PerfectHash(std::vector<std::string_view> keys)
+	: m_Keys{ std::move(keys) }, m_Seeds(std::max<std::size_t>(1, m_Keys.size() / BUCKET_SIZE)), m_Slots(std::bit_ceil(std::max<std::size_t>(1, m_Keys.size() + m_Keys.size() / 4)), NO_KEY)
+{
+	auto hashes = std::vector<std::uint64_t>{};
+	hashes.reserve(m_Keys.size());
+	for (const auto& key : m_Keys)
+		hashes.push_back(Hash(key));
+
+	// the largest buckets are placed first (while most slots are still free)
+	auto buckets = std::vector<std::vector<std::uint32_t>>(m_Seeds.size());
+	for (std::uint32_t i = 0; i < m_Keys.size(); i++)
+		buckets[Bucket(hashes[i])].push_back(i);
+
+	auto order = std::vector<std::size_t>(buckets.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::ranges::stable_sort(order, std::greater<>{}, [&buckets](std::size_t bucket) { return buckets[bucket].size(); });
+
+	auto slots = std::vector<std::size_t>{};
+	for (const auto bucket : order) {
+		const auto& members = buckets[bucket];
+		if (members.empty())
+			break;
+
+		auto seed = std::uint32_t{ 0 };
+		for (;; seed++) {
+			if (seed == MAX_SEED)
+				throw std::invalid_argument{ "keys of the perfect hash are not distinct" };
+
+			slots.clear();
+			for (const auto key : members) {
+				const auto slot = Slot(hashes[key], seed);
+				if (m_Slots[slot] != NO_KEY || std::ranges::find(slots, slot) != slots.end())
+					break;
+
+				slots.push_back(slot);
+			}
+
+			if (slots.size() == members.size())
+				break;
+		}
+
+		m_Seeds[bucket] = seed;
+		for (std::size_t i = 0; i < members.size(); i++)
+			m_Slots[slots[i]] = members[i];
+	}
+}
+
+std::uint64_t PerfectHash::Hash(const std::string_view& key) noexcept
+{
+	// FNV-1a (the keys are short names), mixed so the upper bits which select the bucket depend on all characters
+	auto hash = std::uint64_t{ 0xCBF29CE484222325 };
+	for (const auto c : key)
+		hash = (hash ^ static_cast<std::uint8_t>(c)) * 0x100000001B3;
+
+	return Mix(hash);
+}
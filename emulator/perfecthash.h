@@ -0,0 +1,60 @@
+#pragma once
+#ifndef _GAMESPY_PERFECTHASH_H_
+#define _GAMESPY_PERFECTHASH_H_
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace gamespy {
+	// lookup table for a fixed set of keys (hash and displace):
+	// - the keys are distributed to buckets of about BUCKET_SIZE keys, every bucket stores the seed which places its keys into free slots
+	// - a lookup hashes the key once and compares it with the only key which may be stored in its slot
+	// Note: the table refers to the keys, which have to outlive it
+	class PerfectHash {
+	public:
+		static constexpr std::size_t BUCKET_SIZE = 4;
+		static constexpr std::uint32_t MAX_SEED = 1 << 20; // buckets which can not be placed mean that keys are not distinct
+
+	private:
+		static constexpr std::uint32_t NO_KEY = ~std::uint32_t{ 0 };
+
+		std::vector<std::string_view> m_Keys;
+		std::vector<std::uint32_t> m_Seeds; // by bucket
+		std::vector<std::uint32_t> m_Slots; // index of the key (or NO_KEY), the size is a power of two
+
+		static std::uint64_t Hash(const std::string_view& key) noexcept;
+		// finalizer of murmur3
+		static constexpr std::uint64_t Mix(std::uint64_t value) noexcept
+		{
+			value = (value ^ (value >> 33)) * 0xFF51AFD7ED558CCD;
+			value = (value ^ (value >> 33)) * 0xC4CEB9FE1A85EC53;
+			return value ^ (value >> 33);
+		}
+
+		std::size_t Bucket(std::uint64_t hash) const noexcept { return static_cast<std::size_t>((hash >> 32) * m_Seeds.size() >> 32); }
+		// every seed yields an independent slot
+		std::size_t Slot(std::uint64_t hash, std::uint32_t seed) const noexcept { return static_cast<std::size_t>(Mix(hash + seed * 0x9E3779B97F4A7C15)) & (m_Slots.size() - 1); }
+
+	public:
+		PerfectHash();
+		// throws std::invalid_argument if the keys are not distinct
+		explicit PerfectHash(std::vector<std::string_view> keys);
+
+		std::size_t size() const noexcept { return m_Keys.size(); }
+
+		// position of the key within the keys passed to the constructor
+		std::optional<std::size_t> Find(const std::string_view& key) const noexcept
+		{
+			const auto hash = Hash(key);
+			const auto index = m_Slots[Slot(hash, m_Seeds[Bucket(hash)])];
+			if (index == NO_KEY || m_Keys[index] != key)
+				return std::nullopt;
+
+			return index;
+		}
+	};
+}
+
+#endif
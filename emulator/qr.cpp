@@ -1,4 +1,7 @@
 #include "qr.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstring>
 #include <print>
 #include <ranges>
 #include <utility>
@@ -13,7 +16,7 @@ std::expected<QRPacket, QRPacket::ParseError> QRPacket::Parse(const std::span<co
 	if (buffer[0] > std::to_underlying(Type::PREQUERY_IP_VERIFY))
 		return std::unexpected(ParseError::UNKNOWN_TYPE);
 
-	const auto data = std::vector<std::uint8_t>{ buffer.begin() + 5, buffer.end() };
+	const auto data = buffer.subspan(5);
 	if (!data.empty() && data.back() != 0)
 		return std::unexpected(ParseError::UNEXPECTED_END);
 
@@ -24,134 +27,188 @@ std::expected<QRPacket, QRPacket::ParseError> QRPacket::Parse(const std::span<co
 	};
 }
 
-struct QRMap
+std::string_view QRPacket::str() const noexcept
 {
-	std::map<std::string, std::string> data;
+	const auto begin = reinterpret_cast<const char*>(data.data());
+	return { begin, ::strnlen(begin, data.size()) };
+}
 
-	template<typename Iter = std::forward_iterator_tag>
-	static std::expected<QRMap, QRPacket::ParseError> Parse(Iter& pos, const Iter& end)
+namespace {
+	// reads null-terminated strings from the packet data without copying them
+	struct QRReader
 	{
-		using ParseError = QRPacket::ParseError;
-		if (pos == end)
-			return std::unexpected(ParseError::TOO_SMALL);
-
-		std::map<std::string, std::string> data;
-		std::string key;
-		while (pos != end) {
-			auto strEnd = std::find(pos, end, '\0');
+		std::span<const std::uint8_t>::iterator pos;
+		const std::span<const std::uint8_t>::iterator end;
+
+		bool empty() const noexcept { return pos == end; }
+
+		std::expected<std::string_view, QRPacket::ParseError> Next()
+		{
+			const auto strEnd = std::find(pos, end, '\0');
 			if (strEnd == end)
-				return std::unexpected(ParseError::TOO_SMALL);
+				return std::unexpected(QRPacket::ParseError::TOO_SMALL);
 
-			auto str = std::string{ pos, strEnd };
+			const auto str = std::string_view{ reinterpret_cast<const char*>(std::to_address(pos)), static_cast<std::size_t>(strEnd - pos) };
 			pos = strEnd + 1;
+			return str;
+		}
+	};
 
-			if (key.empty()) {
-				if (str.empty()) {
-					// empy string (indicates map is finished)
-					break;
-				}
+	std::expected<std::vector<QRHeartbeatPacket::KeyValue>, QRPacket::ParseError> ParseMap(QRReader& reader)
+	{
+		if (reader.empty())
+			return std::unexpected(QRPacket::ParseError::TOO_SMALL);
 
-				std::swap(key, str);
-			}
-			else {
-				data.emplace(key, std::move(str));
-				key.clear();
-			}
+		auto data = std::vector<QRHeartbeatPacket::KeyValue>{};
+		data.reserve(64); // enough for the server keys of most games
+		while (!reader.empty()) {
+			const auto key = reader.Next();
+			if (!key)
+				return std::unexpected(key.error());
+
+			// empy string (indicates map is finished)
+			if (key->empty())
+				break;
+
+			const auto value = reader.Next();
+			if (!value)
+				return std::unexpected(value.error());
+
+			data.emplace_back(*key, *value);
 		}
 
-		return QRMap{
-			.data = data
-		};
-	}
-};
+		// sorting by key and position (views are ordered by their position within the packet) allows
+		// the removal of duplicates while keeping the first occurence
+		std::ranges::sort(data, [](const auto& lhs, const auto& rhs) {
+			if (lhs.first != rhs.first)
+				return lhs.first < rhs.first;
 
-struct QRTable
-{
-	using row_t = std::vector<std::string>;
-	row_t header;
-	std::vector<row_t> rows;
+			return lhs.first.data() < rhs.first.data();
+		});
 
-	template<typename Iter = std::forward_iterator_tag>
-	static std::expected<QRTable, QRPacket::ParseError> Parse(Iter& pos, const Iter& end, const std::string_view& headerEnd)
+		const auto [first, last] = std::ranges::unique(data, {}, &QRHeartbeatPacket::KeyValue::first);
+		data.erase(first, last);
+		return data;
+	}
+
+	struct QRTable
 	{
-		using ParseError = QRPacket::ParseError;
-		if (pos == end)
-			return std::unexpected(ParseError::TOO_SMALL);
-
-		std::uint16_t count = *pos++ << 8;
-		if (pos == end)
-			return std::unexpected(ParseError::TOO_SMALL);
-		count |= *pos++;
-		
-		bool headersParsed = false;
-		row_t headers;
-		std::vector<row_t> rows;
-
-		while (pos != end) {
-			auto columnEnd = std::find(pos, end, '\0');
-			if (columnEnd == end)
+		std::vector<std::string_view> header;
+		std::vector<std::string_view> values;
+
+		static std::expected<QRTable, QRPacket::ParseError> Parse(QRReader& reader, const std::string_view& headerEnd)
+		{
+			using ParseError = QRPacket::ParseError;
+			if (reader.empty())
 				return std::unexpected(ParseError::TOO_SMALL);
 
-			auto column = std::string{ pos, columnEnd };
-			pos = columnEnd + 1;
+			std::uint16_t count = *reader.pos++ << 8;
+			if (reader.empty())
+				return std::unexpected(ParseError::TOO_SMALL);
+			count |= *reader.pos++;
 
-			if (!headersParsed && column.ends_with(headerEnd))
-				headers.push_back(std::move(column));
-			else {
-				if (headers.empty())
-					return std::unexpected(ParseError::UNEXPECTED_END);
+			auto table = QRTable{};
+			table.header.reserve(16);
+			while (true) {
+				const auto column = reader.Next();
+				if (!column)
+					return std::unexpected(column.error());
 
 				// empty column indicates end of headers
-				if (column.empty()) {
-					headersParsed = true;
-					if (count == 0)
-						break;
+				if (column->empty())
+					break;
 
-					continue;
-				}
+				if (!column->ends_with(headerEnd))
+					return std::unexpected(ParseError::UNEXPECTED_END);
 
-				if (rows.empty() || rows.back().size() == headers.size())
-					rows.emplace_back();
+				table.header.push_back(*column);
+			}
 
-				rows.back().push_back(std::move(column));
+			if (table.header.empty())
+				return std::unexpected(ParseError::UNEXPECTED_END);
 
-				if (rows.size() == count && rows.back().size() == headers.size())
-					break;
+			// the count is not trusted: every value takes at least its terminator, so a table with more
+			// values than bytes left can not be complete (and must not reserve memory for them)
+			const auto numValues = static_cast<std::size_t>(count) * table.header.size();
+			if (numValues > static_cast<std::size_t>(reader.end - reader.pos))
+				return std::unexpected(ParseError::TOO_SMALL);
+
+			table.values.reserve(numValues);
+			for (std::size_t i = 0; i < numValues; i++) {
+				const auto value = reader.Next();
+				if (!value)
+					return std::unexpected(value.error());
+
+				table.values.push_back(*value);
 			}
+
+			return table;
 		}
+	};
+}
+
+std::optional<std::string_view> QRHeartbeatPacket::GetValue(const std::string_view& key) const noexcept
+{
+	const auto iter = std::ranges::lower_bound(server, key, {}, &KeyValue::first);
+	if (iter == server.end() || iter->first != key)
+		return std::nullopt;
+
+	return iter->second;
+}
 
-		if (rows.size() < count || (!rows.empty() && rows.back().size() != headers.size()))
-			return std::unexpected(ParseError::TOO_SMALL);
+std::map<std::string, std::string> QRHeartbeatPacket::GetServerValues() const
+{
+	// server is already sorted, so every element is inserted at the end
+	auto values = std::map<std::string, std::string>{};
+	for (const auto& [key, value] : server)
+		values.emplace_hint(values.end(), key, value);
+
+	return values;
+}
+
+std::uint64_t QRHeartbeatPacket::GetFingerprint() const noexcept
+{
+	// the terminators are part of the hash so that moving characters between keys and values changes it
+	auto hash = utils::fnv1a({});
+	const auto add = [&hash](const std::string_view& str) {
+		hash = utils::fnv1a({ str.data(), str.size() + 1 }, hash);
+	};
 
-		return QRTable{
-			.header = headers,
-			.rows = rows
-		};
+	for (const auto& [key, value] : server) {
+		add(key);
+		add(value);
 	}
-};
+
+	// the tables are separated by an empty string (which is never a key)
+	for (const auto& table : { &playerKeys, &playerValues, &teamKeys, &teamValues }) {
+		add("");
+		for (const auto& str : *table)
+			add(str);
+	}
+
+	return hash;
+}
 
 std::expected<QRHeartbeatPacket, QRPacket::ParseError> QRHeartbeatPacket::Parse(const QRPacket& packet)
 {
-	auto pos = packet.data.begin();
-	auto end = packet.data.end();
+	auto reader = QRReader{ .pos = packet.data.begin(), .end = packet.data.end() };
 
-	if (auto map = QRMap::Parse(pos, end); map) {
-		if (auto players = QRTable::Parse(pos, end, "_"); players) {
-			if (auto teams = QRTable::Parse(pos, end, "_t"); teams) {
+	if (auto map = ParseMap(reader); map) {
+		if (auto players = QRTable::Parse(reader, "_"); players) {
+			if (auto teams = QRTable::Parse(reader, "_t"); teams) {
 				return QRHeartbeatPacket{
 					packet.type,
 					packet.instance,
-					{},
-					map->data,
-					players->header,
-					players->rows,
-					teams->header,
-					teams->rows
+					packet.data,
+					std::move(*map),
+					std::move(players->header),
+					std::move(players->values),
+					std::move(teams->header),
+					std::move(teams->values)
 				};
 			}
 		}
-		
 	}
 	
 	return std::unexpected(QRPacket::ParseError::TOO_SMALL);
-}
\ No newline at end of file
+}
@@ -4,6 +4,8 @@
 #include <vector>
 #include <utility>
 #include <string>
+#include <string_view>
+#include <optional>
 #include <map>
 #include <expected>
 #include <span>
@@ -33,7 +35,10 @@ namespace gamespy {
 
 		const Type type;
 		const std::array<std::uint8_t, 4> instance;
-		const std::vector<std::uint8_t> data;
+		const std::span<const std::uint8_t> data; // view into the received datagram (the packet must not outlive it)
+
+		// data as null-terminated string (e.g. gamename of PREQUERY_IP_VERIFY or the proof of CHALLENGE)
+		std::string_view str() const noexcept;
 
 		static std::expected<QRPacket, ParseError> Parse(const std::span<const std::uint8_t>& buffer);
 
@@ -47,11 +52,24 @@ namespace gamespy {
 
 	struct QRHeartbeatPacket : QRPacket
 	{
-		const std::map<std::string, std::string> server;
-		const std::vector<std::string> playerKeys;
-		const std::vector<std::vector<std::string>> playerValues;
-		const std::vector<std::string> teamKeys;
-		const std::vector<std::vector<std::string>> teamValues;
+		using KeyValue = std::pair<std::string_view, std::string_view>;
+
+		// all keys and values are views into the received datagram:
+		// - server is sorted by key and contains every key only once (first occurence wins)
+		// - player- and team-values are stored row by row (value of row r, column c: values[r * keys.size() + c])
+		const std::vector<KeyValue> server;
+		const std::vector<std::string_view> playerKeys;
+		const std::vector<std::string_view> playerValues;
+		const std::vector<std::string_view> teamKeys;
+		const std::vector<std::string_view> teamValues;
+
+		std::optional<std::string_view> GetValue(const std::string_view& key) const noexcept;
+
+		// copies the server values into owned storage (only required when they are actually stored)
+		std::map<std::string, std::string> GetServerValues() const;
+
+		// hash of all server keys and values and of the player- and team-tables, equal values result in the same fingerprint
+		std::uint64_t GetFingerprint() const noexcept;
 
 		static std::expected<QRHeartbeatPacket, ParseError> Parse(const QRPacket& packet);
 
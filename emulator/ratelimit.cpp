@@ -0,0 +1,51 @@
+#include "ratelimit.h"
+#include "utils.h"
+#include <algorithm>
+#include <bit>
+#include <string_view>
+using namespace gamespy;
+
+RateLimiter::RateLimiter(const params_t& params)
+	: m_Rate{ std::max(params.rate, 0.0) }, m_Burst{ params.burst > 0.0 ? params.burst : std::max(m_Rate * 2, 1.0) }, m_HashKey{ utils::random_key() }
+{
+	if (IsEnabled())
+		m_Buckets.assign(std::bit_ceil(std::max<std::size_t>(params.buckets, 1)), bucket_t{ .tokens = static_cast<float>(m_Burst), .last_refill = {} });
+}
+
+bool RateLimiter::Allow(const boost::asio::ip::address& address, const Clock::time_point& now)
+{
+	if (!IsEnabled()) {
+		m_Stats.allowed++;
+		return true;
+	}
+
+	std::uint64_t hash = 0;
+	if (address.is_v4()) {
+		const auto bytes = address.to_v4().to_bytes();
+		hash = utils::keyed_hash(std::string_view{ reinterpret_cast<const char*>(bytes.data()), bytes.size() }, m_HashKey);
+	}
+	else {
+		const auto bytes = address.to_v6().to_bytes();
+		hash = utils::keyed_hash(std::string_view{ reinterpret_cast<const char*>(bytes.data()), bytes.size() }, m_HashKey);
+	}
+
+	auto& bucket = m_Buckets[hash & (m_Buckets.size() - 1)];
+	if (bucket.last_refill == Clock::time_point{}) {
+		// unused bucket
+		bucket.tokens = static_cast<float>(m_Burst);
+	}
+	else if (now > bucket.last_refill) {
+		const auto elapsed = std::chrono::duration<double>(now - bucket.last_refill).count();
+		bucket.tokens = static_cast<float>(std::min(m_Burst, bucket.tokens + elapsed * m_Rate));
+	}
+	bucket.last_refill = std::max(bucket.last_refill, now);
+
+	if (bucket.tokens < 1.0f) {
+		m_Stats.dropped++;
+		return false;
+	}
+
+	bucket.tokens -= 1.0f;
+	m_Stats.allowed++;
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef _GAMESPY_RATELIMIT_H_
+#define _GAMESPY_RATELIMIT_H_
+
+#include "asio.h"
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace gamespy {
+	// per source ip admission control (token bucket):
+	// - a fixed amount of buckets is indexed by the hash of the address, so the memory does not grow with the number of sources
+	//   (addresses which share a bucket also share its tokens, which only makes the limit stricter for them)
+	// - the hash is keyed per process, so addresses which share the bucket of another source can not be chosen
+	// - tokens are refilled lazily when a bucket is used again
+	// Note: not thread-safe, each io thread (e.g. master server shard) uses its own limiter
+	class RateLimiter {
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		struct params_t
+		{
+			const double rate = 0.0; // packets per second and source ip, 0 disables the limiter
+			const double burst = 0.0; // bucket size, defaults to two seconds worth of packets
+			const std::size_t buckets = 4096; // rounded up to the next power of two
+		};
+
+		struct Stats {
+			std::uint64_t allowed = 0;
+			std::uint64_t dropped = 0;
+		};
+
+	private:
+		struct bucket_t {
+			float tokens;
+			Clock::time_point last_refill;
+		};
+
+		const double m_Rate;
+		const double m_Burst;
+		const std::uint64_t m_HashKey;
+		std::vector<bucket_t> m_Buckets;
+		Stats m_Stats;
+
+	public:
+		RateLimiter(const params_t& params);
+
+		bool IsEnabled() const noexcept { return m_Rate > 0.0; }
+		const Stats& GetStats() const noexcept { return m_Stats; }
+
+		// consumes a token of the bucket of this address, returns false if the packet should be dropped
+		bool Allow(const boost::asio::ip::address& address, const Clock::time_point& now = Clock::now());
+	};
+}
+
+#endif
@@ -0,0 +1,448 @@
+#include "registry.h"
+#include <algorithm>
+#include <format>
+#include <optional>
+#include <print>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+using namespace gamespy;
+
+namespace {
+	constexpr auto MAGIC = std::string_view{ "GSRG" };
+	// magic, version, shard, shards and the time the log was written
+	constexpr std::size_t HEADER_SIZE = MAGIC.size() + 3 * sizeof(std::uint32_t) + sizeof(std::uint64_t);
+
+	enum class RecordType : std::uint8_t {
+		SERVER = 1, // endpoint followed by the entry
+		REMOVED = 2, // endpoint
+		FLUSHED = 3 // time of the flush
+	};
+
+	std::uint64_t GetEndpointKey(std::uint32_t ip, std::uint16_t port) noexcept
+	{
+		return static_cast<std::uint64_t>(ip) << 16 | port;
+	}
+
+	template<typename T> requires std::is_unsigned_v<T>
+	void AppendInt(std::string& data, T value)
+	{
+		for (std::size_t i = 0; i < sizeof(T); i++)
+			data.push_back(static_cast<char>(value >> (i * 8)));
+	}
+
+	void AppendString(std::string& data, const std::string_view& value)
+	{
+		AppendInt(data, static_cast<std::uint32_t>(value.size()));
+		data.append(value);
+	}
+
+	void AppendStrings(std::string& data, const std::span<const std::string_view>& values)
+	{
+		AppendInt(data, static_cast<std::uint32_t>(values.size()));
+		for (const auto& value : values)
+			AppendString(data, value);
+	}
+
+	std::int64_t ToMilliseconds(const Clock::time_point& time)
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+	}
+
+	void AppendHeader(std::string& data, const RegistryFile::Header& header)
+	{
+		data.append(MAGIC);
+		AppendInt(data, RegistryFile::VERSION);
+		AppendInt(data, header.shard);
+		AppendInt(data, header.shards);
+		AppendInt(data, static_cast<std::uint64_t>(ToMilliseconds(header.saved_at)));
+	}
+
+	// size (of the type and the payload), type and the payload which is appended by appendPayload
+	template<typename F>
+	void AppendRecord(std::string& data, RecordType type, F&& appendPayload)
+	{
+		const auto start = data.size();
+		AppendInt(data, std::uint32_t{ 0 });
+		AppendInt(data, std::to_underlying(type));
+		appendPayload();
+
+		const auto size = static_cast<std::uint32_t>(data.size() - start - sizeof(size));
+		for (std::size_t i = 0; i < sizeof(size); i++)
+			data[start + i] = static_cast<char>(size >> (i * 8));
+	}
+
+	void AppendServer(std::string& data, const RegistryFile::Entry& entry)
+	{
+		const auto& server = entry.server;
+		AppendInt(data, server.ip);
+		AppendInt(data, server.port);
+		AppendString(data, entry.gamename);
+		data.append(entry.instance.begin(), entry.instance.end());
+		AppendInt(data, entry.fingerprint);
+		AppendInt(data, static_cast<std::uint64_t>(ToMilliseconds(server.last_update)));
+
+		AppendInt(data, static_cast<std::uint32_t>(server.values.size()));
+		for (const auto& [key, value] : server.values) {
+			AppendString(data, key);
+			AppendString(data, value);
+		}
+
+		for (const auto& table : { server.playerKeys, server.playerValues, server.teamKeys, server.teamValues })
+			AppendStrings(data, table);
+	}
+
+	Clock::time_point FromMilliseconds(std::int64_t milliseconds)
+	{
+		return Clock::time_point{ std::chrono::duration_cast<Clock::duration>(std::chrono::milliseconds{ milliseconds }) };
+	}
+
+	// reads the integers and strings of the file without copying them
+	struct RegistryReader
+	{
+		std::string_view data;
+
+		template<typename T> requires std::is_unsigned_v<T>
+		std::expected<T, RegistryFile::ParseError> Int()
+		{
+			if (data.size() < sizeof(T))
+				return std::unexpected(RegistryFile::ParseError::UNEXPECTED_END);
+
+			auto value = T{ 0 };
+			for (std::size_t i = 0; i < sizeof(T); i++)
+				value |= static_cast<T>(static_cast<std::uint8_t>(data[i])) << (i * 8);
+
+			data.remove_prefix(sizeof(T));
+			return value;
+		}
+
+		std::expected<std::string_view, RegistryFile::ParseError> String()
+		{
+			const auto length = Int<std::uint32_t>();
+			if (!length)
+				return std::unexpected(length.error());
+			if (data.size() < *length)
+				return std::unexpected(RegistryFile::ParseError::UNEXPECTED_END);
+
+			const auto value = data.substr(0, *length);
+			data.remove_prefix(*length);
+			return value;
+		}
+
+		// count followed by the strings
+		std::expected<void, RegistryFile::ParseError> Strings(std::vector<std::string_view>& values)
+		{
+			const auto count = Int<std::uint32_t>();
+			if (!count)
+				return std::unexpected(count.error());
+
+			values.clear();
+			for (std::uint32_t i = 0; i < *count; i++) {
+				const auto value = String();
+				if (!value)
+					return std::unexpected(value.error());
+
+				values.push_back(*value);
+			}
+
+			return {};
+		}
+	};
+
+	struct record_t {
+		RecordType type;
+		std::string_view payload;
+		std::string_view bytes; // the whole record
+	};
+
+	// removes the next record from data, nullopt at the end of data or if the record was cut off
+	std::optional<record_t> NextRecord(std::string_view& data)
+	{
+		auto reader = RegistryReader{ .data = data };
+		const auto size = reader.Int<std::uint32_t>();
+		if (!size || *size == 0 || reader.data.size() < *size)
+			return std::nullopt;
+
+		const auto record = record_t{
+			.type = static_cast<RecordType>(reader.data[0]),
+			.payload = reader.data.substr(1, *size - 1),
+			.bytes = data.substr(0, sizeof(std::uint32_t) + *size)
+		};
+		data.remove_prefix(record.bytes.size());
+		return record;
+	}
+
+	// endpoint of a SERVER or REMOVED record
+	std::optional<std::uint64_t> GetEndpointKey(const std::string_view& payload)
+	{
+		auto reader = RegistryReader{ .data = payload };
+		const auto ip = reader.Int<std::uint32_t>();
+		const auto port = reader.Int<std::uint16_t>();
+		if (!ip || !port)
+			return std::nullopt;
+
+		return GetEndpointKey(*ip, *port);
+	}
+}
+
+RegistryFile::Writer::Writer(const std::filesystem::path& path, const Header& header)
+	: m_Path{ path }, m_Header{ header }, m_Thread{ [this](std::stop_token stop) { Run(stop); } }
+{
+
+}
+
+RegistryFile::Writer::~Writer()
+{
+	Flush();
+	m_Thread.request_stop();
+	m_Thread.join();
+}
+
+void RegistryFile::Writer::Add(const Entry& entry)
+{
+	auto lock = std::scoped_lock{ m_Mutex };
+	AppendRecord(m_Pending, RecordType::SERVER, [&] { AppendServer(m_Pending, entry); });
+}
+
+void RegistryFile::Writer::Remove(std::uint32_t ip, std::uint16_t port)
+{
+	auto lock = std::scoped_lock{ m_Mutex };
+	AppendRecord(m_Pending, RecordType::REMOVED, [&] {
+		AppendInt(m_Pending, ip);
+		AppendInt(m_Pending, port);
+	});
+}
+
+void RegistryFile::Writer::Flush(const Clock::time_point& now)
+{
+	{
+		auto lock = std::scoped_lock{ m_Mutex };
+		AppendRecord(m_Pending, RecordType::FLUSHED, [&] { AppendInt(m_Pending, static_cast<std::uint64_t>(ToMilliseconds(now))); });
+		m_FlushRequested = true;
+	}
+	m_Wakeup.notify_one();
+}
+
+void RegistryFile::Writer::Run(std::stop_token stop)
+{
+	auto records = std::string{};
+	while (true) {
+		{
+			auto lock = std::unique_lock{ m_Mutex };
+			m_Wakeup.wait(lock, stop, [this] { return m_FlushRequested; });
+			m_FlushRequested = false;
+			records.swap(m_Pending);
+		}
+
+		// once stopped, the thread only returns after the last records were written
+		if (records.empty()) {
+			if (stop.stop_requested())
+				return;
+
+			continue;
+		}
+
+		Write(records);
+		records.clear();
+	}
+}
+
+void RegistryFile::Writer::Write(const std::string_view& records)
+{
+	// the last record of every server is what a compacted log contains
+	for (auto data = records; const auto record = NextRecord(data);) {
+		if (record->type == RecordType::FLUSHED)
+			continue;
+
+		const auto key = GetEndpointKey(record->payload);
+		if (!key)
+			continue;
+
+		if (const auto found = m_Servers.find(*key); found != m_Servers.end()) {
+			m_ServersSize -= found->second.size();
+			m_Servers.erase(found);
+		}
+
+		if (record->type == RecordType::SERVER) {
+			m_Servers.emplace(*key, record->bytes);
+			m_ServersSize += record->bytes.size();
+		}
+	}
+
+	try {
+		if (!m_File.is_open() || m_FileSize + records.size() > std::max(COMPACT_MIN_SIZE, COMPACT_RATIO * m_ServersSize)) {
+			Compact();
+			return;
+		}
+
+		m_File.write(records.data(), static_cast<std::streamsize>(records.size()));
+		m_File.flush();
+		if (!m_File) {
+			// the log is rewritten by the next flush
+			m_File.close();
+			throw std::runtime_error{ std::format("Unable to write file `{}`", m_Path.generic_string()) };
+		}
+
+		m_FileSize += records.size();
+	}
+	catch (std::exception& e) {
+		std::println("[master] failed to save the registry: {}", e.what());
+	}
+}
+
+void RegistryFile::Writer::Compact()
+{
+	m_File.close();
+
+	auto header = std::string{};
+	AppendHeader(header, Header{ .shard = m_Header.shard, .shards = m_Header.shards, .saved_at = Clock::now() });
+
+	auto temporary = m_Path;
+	temporary += ".tmp";
+	{
+		auto file = std::ofstream{ temporary, std::ios::out | std::ios::binary | std::ios::trunc };
+		if (!file.is_open())
+			throw std::runtime_error{ std::format("Unable to create file `{}`", temporary.generic_string()) };
+
+		file.write(header.data(), static_cast<std::streamsize>(header.size()));
+		for (const auto& [key, record] : m_Servers)
+			file.write(record.data(), static_cast<std::streamsize>(record.size()));
+
+		file.close();
+		if (!file)
+			throw std::runtime_error{ std::format("Unable to write file `{}`", temporary.generic_string()) };
+	}
+
+	std::filesystem::rename(temporary, m_Path);
+	m_File.open(m_Path, std::ios::out | std::ios::binary | std::ios::app);
+	if (!m_File.is_open())
+		throw std::runtime_error{ std::format("Unable to open file `{}`", m_Path.generic_string()) };
+
+	m_FileSize = header.size() + m_ServersSize;
+}
+
+std::expected<RegistryFile, RegistryFile::ParseError> RegistryFile::Load(const std::filesystem::path& path)
+{
+	auto file = std::ifstream{ path, std::ios::in | std::ios::binary };
+	if (!file.is_open())
+		return std::unexpected(ParseError::NOT_FOUND);
+
+	auto registry = RegistryFile{};
+	registry.m_Data.resize(static_cast<std::size_t>(std::filesystem::file_size(path)));
+	if (!file.read(registry.m_Data.data(), static_cast<std::streamsize>(registry.m_Data.size())))
+		return std::unexpected(ParseError::UNEXPECTED_END);
+
+	auto reader = RegistryReader{ .data = registry.m_Data };
+	if (!reader.data.starts_with(MAGIC))
+		return std::unexpected(ParseError::INVALID_HEADER);
+	reader.data.remove_prefix(MAGIC.size());
+
+	const auto version = reader.Int<std::uint32_t>();
+	if (!version)
+		return std::unexpected(ParseError::INVALID_HEADER);
+	if (*version != VERSION)
+		return std::unexpected(ParseError::UNSUPPORTED_VERSION);
+
+	const auto shard = reader.Int<std::uint32_t>();
+	const auto shards = reader.Int<std::uint32_t>();
+	const auto savedAt = reader.Int<std::uint64_t>();
+	if (!shard || !shards || !savedAt)
+		return std::unexpected(ParseError::INVALID_HEADER);
+
+	registry.m_Header = Header{
+		.shard = *shard,
+		.shards = *shards,
+		.saved_at = FromMilliseconds(static_cast<std::int64_t>(*savedAt))
+	};
+
+	// the records are replayed, only the last record of every server which was not removed is kept
+	auto servers = std::unordered_map<std::uint64_t, std::string_view>{};
+	while (const auto record = NextRecord(reader.data)) {
+		if (record->type == RecordType::FLUSHED) {
+			auto payload = RegistryReader{ .data = record->payload };
+			if (const auto flushedAt = payload.Int<std::uint64_t>())
+				registry.m_Header.saved_at = std::max(registry.m_Header.saved_at, FromMilliseconds(static_cast<std::int64_t>(*flushedAt)));
+			continue;
+		}
+
+		const auto key = GetEndpointKey(record->payload);
+		if (!key)
+			return std::unexpected(ParseError::UNEXPECTED_END);
+
+		if (record->type == RecordType::SERVER)
+			servers.insert_or_assign(*key, record->payload);
+		else if (record->type == RecordType::REMOVED)
+			servers.erase(*key);
+	}
+
+	registry.m_Truncated = !reader.data.empty();
+	registry.m_Entries.reserve(servers.size());
+	for (const auto& [key, payload] : servers)
+		registry.m_Entries.emplace_back(static_cast<std::size_t>(payload.data() - registry.m_Data.data()), payload.size());
+
+	return registry;
+}
+
+std::expected<std::uint32_t, RegistryFile::ParseError> RegistryFile::ForEach(const std::function<void(const Entry&)>& callback) const
+{
+	// the vectors are reused by all entries
+	auto values = std::vector<std::pair<std::string_view, std::string_view>>{};
+	auto tables = std::array<std::vector<std::string_view>, 4>{};
+	for (const auto& [offset, length] : m_Entries) {
+		auto reader = RegistryReader{ .data = std::string_view{ m_Data }.substr(offset, length) };
+		const auto ip = reader.Int<std::uint32_t>();
+		const auto port = reader.Int<std::uint16_t>();
+		const auto gamename = reader.String();
+		if (!ip || !port || !gamename)
+			return std::unexpected(ParseError::UNEXPECTED_END);
+
+		auto instance = std::array<std::uint8_t, 4>{};
+		for (auto& byte : instance) {
+			const auto value = reader.Int<std::uint8_t>();
+			if (!value)
+				return std::unexpected(value.error());
+
+			byte = *value;
+		}
+
+		const auto fingerprint = reader.Int<std::uint64_t>();
+		const auto lastUpdate = reader.Int<std::uint64_t>();
+		const auto numValues = reader.Int<std::uint32_t>();
+		if (!fingerprint || !lastUpdate || !numValues)
+			return std::unexpected(ParseError::UNEXPECTED_END);
+
+		values.clear();
+		for (std::uint32_t v = 0; v < *numValues; v++) {
+			const auto key = reader.String();
+			const auto value = key ? reader.String() : key;
+			if (!value)
+				return std::unexpected(value.error());
+
+			values.emplace_back(*key, *value);
+		}
+
+		for (auto& table : tables) {
+			if (const auto result = reader.Strings(table); !result)
+				return std::unexpected(result.error());
+		}
+
+		callback(Entry{
+			.gamename = *gamename,
+			.instance = instance,
+			.fingerprint = *fingerprint,
+			.server = {
+				.ip = *ip,
+				.port = *port,
+				.last_update = FromMilliseconds(static_cast<std::int64_t>(*lastUpdate)),
+				.values = values,
+				.playerKeys = tables[0],
+				.playerValues = tables[1],
+				.teamKeys = tables[2],
+				.teamValues = tables[3]
+			}
+		});
+	}
+
+	return size();
+}
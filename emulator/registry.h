@@ -0,0 +1,109 @@
+#pragma once
+#ifndef _GAMESPY_REGISTRY_H_
+#define _GAMESPY_REGISTRY_H_
+
+#include "gamedb.h"
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace gamespy {
+	// log of the validated servers of a master server, restored on startup (warm restart):
+	// - header (magic, version, shard, number of shards, time it was written) followed by records
+	// - every record is prefixed by its size and type: the values of a server, the removal of a server or the time of a flush
+	// - integers are little-endian, strings are prefixed by their 32-bit length
+	// - the Writer only appends the changes, a record which was cut off by a crash is ignored when the log is loaded
+	// - Load reads the whole file with a single read, the entries passed to ForEach only refer to that buffer
+	class RegistryFile {
+	public:
+		static constexpr std::uint32_t VERSION = 2;
+
+		enum class ParseError {
+			NOT_FOUND,
+			INVALID_HEADER,
+			UNSUPPORTED_VERSION,
+			UNEXPECTED_END
+		};
+
+		struct Header {
+			std::uint32_t shard = 0;
+			std::uint32_t shards = 1;
+			Clock::time_point saved_at; // time of the last flush when loaded
+		};
+
+		struct Entry {
+			std::string_view gamename;
+			std::array<std::uint8_t, 4> instance;
+			std::uint64_t fingerprint; // of the last heartbeat (see QRHeartbeatPacket::GetFingerprint)
+			Game::StoredServer server;
+		};
+
+		// appends the changes to the log on a background thread, so the io thread never waits for the disk:
+		// - Add and Remove only serialize the record, Flush wakes up the thread which writes the records
+		// - the thread keeps the last record of every server and rewrites the log from them (temporary file which
+		//   then replaces the log) when it is first flushed and whenever it grew to COMPACT_RATIO times their size
+		class Writer {
+		public:
+			static constexpr std::size_t COMPACT_RATIO = 4;
+			static constexpr std::size_t COMPACT_MIN_SIZE = 1 << 20;
+
+		private:
+			const std::filesystem::path m_Path;
+			const Header m_Header;
+
+			std::mutex m_Mutex;
+			std::condition_variable_any m_Wakeup;
+			std::string m_Pending; // records which were not written yet (guarded by m_Mutex)
+			bool m_FlushRequested = false; // guarded by m_Mutex
+
+			// owned by the thread
+			std::unordered_map<std::uint64_t, std::string> m_Servers; // last record by endpoint
+			std::size_t m_ServersSize = 0;
+			std::ofstream m_File;
+			std::size_t m_FileSize = 0;
+
+			std::jthread m_Thread;
+
+			void Run(std::stop_token stop);
+			void Write(const std::string_view& records);
+			void Compact();
+
+		public:
+			Writer(const std::filesystem::path& path, const Header& header);
+			~Writer(); // writes the changes which were not flushed yet
+
+			void Add(const Entry& entry);
+			void Remove(std::uint32_t ip, std::uint16_t port);
+			void Flush(const Clock::time_point& now = Clock::now());
+		};
+
+	private:
+		std::string m_Data;
+		Header m_Header;
+		std::vector<std::pair<std::size_t, std::size_t>> m_Entries; // offset and size (within m_Data) of the last record of every server which was not removed
+		bool m_Truncated = false;
+
+	public:
+		static std::expected<RegistryFile, ParseError> Load(const std::filesystem::path& path);
+
+		const Header& GetHeader() const noexcept { return m_Header; }
+		std::uint32_t size() const noexcept { return static_cast<std::uint32_t>(m_Entries.size()); }
+		bool IsTruncated() const noexcept { return m_Truncated; } // the last record was cut off (and ignored)
+
+		// calls callback(entry) for every entry, the views of the entry are only valid during the call
+		// returns the number of entries or the error of the first entry which could not be parsed
+		std::expected<std::uint32_t, ParseError> ForEach(const std::function<void(const Entry&)>& callback) const;
+	};
+}
+
+#endif
@@ -170,6 +170,46 @@ unsigned char sapphire::encrypt(unsigned char b)
     // GAMESPY CUSTOMIZATION END
 }
 
+void sapphire::encrypt(std::span<std::uint8_t> data) noexcept
+{
+    // the indices live in registers during the loop (the members are only read and written once),
+    // the steps are the same as in encrypt(b)
+    unsigned char rot = rotor, rat = ratchet, ava = avalanche, plain = last_plain, cipher = last_cipher;
+    unsigned char swaptemp;
+
+    for (auto& b : data)
+    {
+        rat += cards[rot++];
+        swaptemp = cards[cipher];
+        cards[cipher] = cards[rat];
+        cards[rat] = cards[plain];
+        cards[plain] = cards[rot];
+        cards[rot] = swaptemp;
+        ava += cards[swaptemp];
+
+        // GAMESPY CUSTOMIZATION (see encrypt(b))
+        const unsigned char c = b ^ cards[(cards[ava] + cards[rot]) & 0xFF] ^
+            cards[cards[(cards[plain] +
+                cards[cipher] +
+                cards[rat]) & 0xFF]];
+        plain = b;
+        cipher = c;
+        b = c;
+    }
+
+    rotor = rot;
+    ratchet = rat;
+    avalanche = ava;
+    last_plain = plain;
+    last_cipher = cipher;
+}
+
+void sapphire::encrypt(std::span<const std::span<std::uint8_t>> buffers) noexcept
+{
+    for (const auto& buffer : buffers)
+        encrypt(buffer);
+}
+
 unsigned char sapphire::decrypt(unsigned char b)
 {
     unsigned char swaptemp;
@@ -2,9 +2,12 @@
 #ifndef  _GAMESPY_SAPPHIRE_H_
 #define _GAMESPY_SAPPHIRE_H_
 
+#include <cstdint>
 #include <string_view>
 #include <stdexcept>
 #include <ranges>
+#include <span>
+#include <type_traits>
 
 // Gamespy uses a slightly modified Sapphire II stream cipher
 // https://cryptography.org/mpj/sapphire.pdf
@@ -41,11 +44,23 @@ namespace gamespy {
         unsigned char decrypt(unsigned char b);
         unsigned char encrypt(unsigned char b);
 
+        // encrypts the bytes in place (same as encrypt(b) for every byte, but the state is kept in locals during the loop)
+        void encrypt(std::span<std::uint8_t> data) noexcept;
+        // encrypts the buffers in place as one stream (scatter-gather)
+        void encrypt(std::span<const std::span<std::uint8_t>> buffers) noexcept;
+
         template<class R>
             requires std::ranges::range<R>
         void encrypt(R&& range) {
-            for (auto& c: range)
-                c = encrypt(static_cast<unsigned char>(c));
+            using value_type = std::ranges::range_value_t<R>;
+            if constexpr (std::ranges::contiguous_range<R> && std::is_integral_v<value_type> && sizeof(value_type) == 1)
+                encrypt(std::span<std::uint8_t>{ reinterpret_cast<std::uint8_t*>(std::ranges::data(range)), std::ranges::size(range) });
+            else if constexpr (std::ranges::contiguous_range<R> && std::is_same_v<value_type, std::span<std::uint8_t>>)
+                encrypt(std::span<const std::span<std::uint8_t>>{ std::ranges::data(range), std::ranges::size(range) });
+            else {
+                for (auto& c: range)
+                    c = encrypt(static_cast<unsigned char>(c));
+            }
         }
 
     private:
@@ -0,0 +1,724 @@
+#include "serverfilter.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <compare>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GAMESPY_FILTER_SSE2
+#include <emmintrin.h>
+#endif
+using namespace gamespy;
+
+namespace {
+	bool IEquals(const std::string_view& lhs, const std::string_view& rhs) noexcept
+	{
+		if (lhs.size() != rhs.size())
+			return false;
+
+		for (std::size_t i = 0; i < lhs.size(); i++) {
+			if (std::tolower(static_cast<unsigned char>(lhs[i])) != std::tolower(static_cast<unsigned char>(rhs[i])))
+				return false;
+		}
+
+		return true;
+	}
+}
+
+class ServerFilter::Parser {
+	enum class token_t {
+		END,
+		IDENTIFIER,
+		STRING,
+		QUOTED_IDENTIFIER, // "name": a column if it exists, otherwise a string (like sqlite)
+		NUMBER,
+		COMPARISON,
+		LEFT_PARENTHESIS,
+		RIGHT_PARENTHESIS,
+		AND,
+		OR,
+		NOT,
+		LIKE
+	};
+
+	const std::string_view m_Filter;
+	const resolver_t& m_Resolve;
+	ServerFilter& m_Result;
+	std::size_t m_Position = 0;
+	std::size_t m_Depth = 0;
+
+	token_t m_Token = token_t::END;
+	std::string_view m_TokenText;
+	std::string m_TokenString; // value of STRING and QUOTED_IDENTIFIER tokens (without quotes and escapes)
+
+public:
+	Parser(const std::string_view& filter, const resolver_t& resolve, ServerFilter& result)
+		: m_Filter{ filter }, m_Resolve{ resolve }, m_Result{ result }
+	{
+
+	}
+
+	std::expected<void, ParseError> Parse()
+	{
+		if (auto next = Next(); !next)
+			return next;
+
+		if (auto expression = ParseOr(); !expression)
+			return std::unexpected(expression.error());
+
+		if (m_Token != token_t::END)
+			return std::unexpected(ParseError::UNEXPECTED_TOKEN);
+
+		return {};
+	}
+
+private:
+	std::expected<void, ParseError> Next()
+	{
+		while (m_Position < m_Filter.size() && std::isspace(static_cast<unsigned char>(m_Filter[m_Position])))
+			m_Position++;
+
+		const auto begin = m_Position;
+		if (m_Position >= m_Filter.size()) {
+			m_Token = token_t::END;
+			m_TokenText = {};
+			return {};
+		}
+
+		const auto c = m_Filter[m_Position];
+		const auto peek = m_Position + 1 < m_Filter.size() ? m_Filter[m_Position + 1] : '\0';
+		if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+			while (m_Position < m_Filter.size() && (std::isalnum(static_cast<unsigned char>(m_Filter[m_Position])) || m_Filter[m_Position] == '_'))
+				m_Position++;
+
+			m_TokenText = m_Filter.substr(begin, m_Position - begin);
+			if (IEquals(m_TokenText, "and"))
+				m_Token = token_t::AND;
+			else if (IEquals(m_TokenText, "or"))
+				m_Token = token_t::OR;
+			else if (IEquals(m_TokenText, "not"))
+				m_Token = token_t::NOT;
+			else if (IEquals(m_TokenText, "like"))
+				m_Token = token_t::LIKE;
+			else
+				m_Token = token_t::IDENTIFIER;
+
+			return {};
+		}
+
+		if (std::isdigit(static_cast<unsigned char>(c)) || ((c == '-' || c == '.') && (std::isdigit(static_cast<unsigned char>(peek)) || peek == '.'))) {
+			m_Position++;
+			while (m_Position < m_Filter.size()) {
+				const auto n = m_Filter[m_Position];
+				const auto exponentSign = (n == '-' || n == '+') && (m_Filter[m_Position - 1] == 'e' || m_Filter[m_Position - 1] == 'E');
+				if (!std::isdigit(static_cast<unsigned char>(n)) && n != '.' && n != 'e' && n != 'E' && !exponentSign)
+					break;
+
+				m_Position++;
+			}
+
+			m_TokenText = m_Filter.substr(begin, m_Position - begin);
+			m_Token = token_t::NUMBER;
+			if (!ServerStore::ParseNumber(m_TokenText))
+				return std::unexpected(ParseError::UNEXPECTED_TOKEN);
+
+			return {};
+		}
+
+		if (c == '\'' || c == '"') {
+			// quotes within the string are escaped by doubling them
+			m_TokenString.clear();
+			for (m_Position++;; m_Position++) {
+				if (m_Position >= m_Filter.size())
+					return std::unexpected(ParseError::UNTERMINATED_STRING);
+
+				if (m_Filter[m_Position] == c) {
+					if (m_Position + 1 < m_Filter.size() && m_Filter[m_Position + 1] == c)
+						m_Position++;
+					else
+						break;
+				}
+
+				m_TokenString.push_back(m_Filter[m_Position]);
+			}
+
+			m_Position++;
+			m_TokenText = m_Filter.substr(begin, m_Position - begin);
+			m_Token = c == '\'' ? token_t::STRING : token_t::QUOTED_IDENTIFIER;
+			return {};
+		}
+
+		m_Position++;
+		switch (c) {
+		case '(': m_Token = token_t::LEFT_PARENTHESIS; break;
+		case ')': m_Token = token_t::RIGHT_PARENTHESIS; break;
+		case '=':
+			if (peek == '=')
+				m_Position++;
+			m_Token = token_t::COMPARISON;
+			break;
+		case '<':
+			if (peek == '=' || peek == '>')
+				m_Position++;
+			m_Token = token_t::COMPARISON;
+			break;
+		case '>':
+			if (peek == '=')
+				m_Position++;
+			m_Token = token_t::COMPARISON;
+			break;
+		case '!':
+			if (peek != '=')
+				return std::unexpected(ParseError::UNEXPECTED_TOKEN);
+			m_Position++;
+			m_Token = token_t::COMPARISON;
+			break;
+		default:
+			return std::unexpected(ParseError::UNEXPECTED_TOKEN);
+		}
+
+		m_TokenText = m_Filter.substr(begin, m_Position - begin);
+		return {};
+	}
+
+	std::uint32_t Add(node_t node)
+	{
+		m_Result.m_Nodes.push_back(std::move(node));
+		return static_cast<std::uint32_t>(m_Result.m_Nodes.size() - 1);
+	}
+
+	// AND and OR chains become a single node with all operands as children
+	std::expected<std::uint32_t, ParseError> ParseChain(token_t separator, opcode_t op, std::expected<std::uint32_t, ParseError> (Parser::*parseOperand)())
+	{
+		const auto first = (this->*parseOperand)();
+		if (!first || m_Token != separator)
+			return first;
+
+		auto node = node_t{ .op = op, .children = { *first } };
+		while (m_Token == separator) {
+			if (auto next = Next(); !next)
+				return std::unexpected(next.error());
+
+			const auto operand = (this->*parseOperand)();
+			if (!operand)
+				return operand;
+
+			node.children.push_back(*operand);
+		}
+
+		return Add(std::move(node));
+	}
+
+	std::expected<std::uint32_t, ParseError> ParseOr()
+	{
+		return ParseChain(token_t::OR, opcode_t::OR, &Parser::ParseAnd);
+	}
+
+	std::expected<std::uint32_t, ParseError> ParseAnd()
+	{
+		return ParseChain(token_t::AND, opcode_t::AND, &Parser::ParseNot);
+	}
+
+	std::expected<std::uint32_t, ParseError> ParseNot()
+	{
+		if (m_Token != token_t::NOT && m_Token != token_t::LEFT_PARENTHESIS)
+			return ParseComparison();
+
+		if (++m_Depth > MAX_DEPTH)
+			return std::unexpected(ParseError::TOO_DEEP);
+
+		const auto isNot = m_Token == token_t::NOT;
+		if (auto next = Next(); !next)
+			return std::unexpected(next.error());
+
+		auto node = isNot ? ParseNot() : ParseOr();
+		if (!node)
+			return node;
+
+		if (isNot)
+			node = Add(node_t{ .op = opcode_t::NOT, .children = { *node } });
+		else if (m_Token != token_t::RIGHT_PARENTHESIS)
+			return std::unexpected(m_Token == token_t::END ? ParseError::UNEXPECTED_END : ParseError::UNEXPECTED_TOKEN);
+		else if (auto next = Next(); !next)
+			return std::unexpected(next.error());
+
+		m_Depth--;
+		return node;
+	}
+
+	std::expected<operand_t, ParseError> ParseOperand()
+	{
+		auto literal = literal_t{};
+		switch (m_Token) {
+		case token_t::IDENTIFIER:
+		case token_t::QUOTED_IDENTIFIER: {
+			const auto name = m_Token == token_t::IDENTIFIER ? std::string{ m_TokenText } : m_TokenString;
+			if (const auto column = m_Resolve(name)) {
+				if (auto next = Next(); !next)
+					return std::unexpected(next.error());
+
+				return operand_t{ .is_column = true, .numeric = column->numeric, .column = column->column };
+			}
+
+			if (m_Token == token_t::IDENTIFIER)
+				return std::unexpected(ParseError::UNKNOWN_COLUMN);
+
+			literal.text = m_TokenString;
+			literal.number = ServerStore::ParseNumber(literal.text);
+			literal.quoted = true;
+			break;
+		}
+
+		case token_t::STRING:
+			literal.text = m_TokenString;
+			literal.number = ServerStore::ParseNumber(literal.text);
+			literal.quoted = true;
+			break;
+
+		case token_t::NUMBER:
+			literal.text = m_TokenText;
+			literal.number = ServerStore::ParseNumber(m_TokenText);
+			break;
+
+		case token_t::END:
+			return std::unexpected(ParseError::UNEXPECTED_END);
+
+		default:
+			return std::unexpected(ParseError::UNEXPECTED_TOKEN);
+		}
+
+		if (auto next = Next(); !next)
+			return std::unexpected(next.error());
+
+		const auto index = static_cast<std::uint32_t>(m_Result.m_Literals.size());
+		const auto numeric = literal.number.has_value();
+		m_Result.m_Literals.push_back(std::move(literal));
+		return operand_t{ .numeric = numeric, .literal = index };
+	}
+
+	std::expected<std::uint32_t, ParseError> ParseComparison()
+	{
+		const auto lhs = ParseOperand();
+		if (!lhs)
+			return std::unexpected(lhs.error());
+
+		auto op = opcode_t::EQUAL;
+		if (m_Token == token_t::COMPARISON) {
+			if (m_TokenText == "=" || m_TokenText == "==")
+				op = opcode_t::EQUAL;
+			else if (m_TokenText == "!=" || m_TokenText == "<>")
+				op = opcode_t::NOT_EQUAL;
+			else if (m_TokenText == "<")
+				op = opcode_t::LESS;
+			else if (m_TokenText == "<=")
+				op = opcode_t::LESS_EQUAL;
+			else if (m_TokenText == ">")
+				op = opcode_t::GREATER;
+			else
+				op = opcode_t::GREATER_EQUAL;
+		}
+		else if (m_Token == token_t::LIKE)
+			op = opcode_t::LIKE;
+		else if (m_Token == token_t::NOT) {
+			if (auto next = Next(); !next)
+				return std::unexpected(next.error());
+			if (m_Token != token_t::LIKE)
+				return std::unexpected(m_Token == token_t::END ? ParseError::UNEXPECTED_END : ParseError::UNEXPECTED_TOKEN);
+
+			op = opcode_t::NOT_LIKE;
+		}
+		else
+			return std::unexpected(m_Token == token_t::END ? ParseError::UNEXPECTED_END : ParseError::UNEXPECTED_TOKEN);
+
+		if (auto next = Next(); !next)
+			return std::unexpected(next.error());
+
+		const auto rhs = ParseOperand();
+		if (!rhs)
+			return std::unexpected(rhs.error());
+
+		auto node = node_t{ .op = op, .lhs = *lhs, .rhs = *rhs };
+		if (op != opcode_t::LIKE && op != opcode_t::NOT_LIKE) {
+			if (lhs->is_column || rhs->is_column)
+				node.numeric = (lhs->is_column && lhs->numeric) || (rhs->is_column && rhs->numeric);
+			else
+				node.numeric = !m_Result.m_Literals[lhs->literal].quoted && !m_Result.m_Literals[rhs->literal].quoted;
+
+			// comparisons of literals are not worth a scan, the text of a column which is not numeric has to be parsed
+			node.scan = node.numeric && (lhs->is_column || rhs->is_column) && lhs->numeric && rhs->numeric;
+			node.interned = !node.numeric && (op == opcode_t::EQUAL || op == opcode_t::NOT_EQUAL) && lhs->is_column != rhs->is_column;
+		}
+
+		return Add(std::move(node));
+	}
+};
+
+namespace {
+	enum class comparison_t {
+		EQUAL,
+		NOT_EQUAL,
+		LESS,
+		LESS_EQUAL,
+		GREATER,
+		GREATER_EQUAL
+	};
+
+	// the comparison of the operands after swapping them
+	template<typename T>
+	T Mirror(T op) noexcept
+	{
+		switch (op) {
+		case T::LESS:          return T::GREATER;
+		case T::LESS_EQUAL:    return T::GREATER_EQUAL;
+		case T::GREATER:       return T::LESS;
+		case T::GREATER_EQUAL: return T::LESS_EQUAL;
+		default:               return op;
+		}
+	}
+
+	// compares a column of a page with another column (rhs) or a single value, bit i of the result is set if lhs[i] op rhs[i]
+	// Note: NaN (not a number) is only unequal, the caller has to handle those rows separately
+	template<comparison_t OP>
+	std::uint64_t ScanNumbers(const double* lhs, const double* rhs, double value) noexcept
+	{
+		static constexpr std::size_t ROWS = ServerStore::PAGE_SIZE;
+		auto result = std::uint64_t{ 0 };
+#if defined(GAMESPY_FILTER_SSE2)
+		const auto broadcast = _mm_set1_pd(value);
+		for (std::size_t i = 0; i < ROWS; i += 4) {
+			const auto a0 = _mm_loadu_pd(lhs + i);
+			const auto a1 = _mm_loadu_pd(lhs + i + 2);
+			const auto b0 = rhs ? _mm_loadu_pd(rhs + i) : broadcast;
+			const auto b1 = rhs ? _mm_loadu_pd(rhs + i + 2) : broadcast;
+
+			__m128d c0, c1;
+			if constexpr (OP == comparison_t::EQUAL)           { c0 = _mm_cmpeq_pd(a0, b0);  c1 = _mm_cmpeq_pd(a1, b1); }
+			else if constexpr (OP == comparison_t::NOT_EQUAL)  { c0 = _mm_cmpneq_pd(a0, b0); c1 = _mm_cmpneq_pd(a1, b1); }
+			else if constexpr (OP == comparison_t::LESS)       { c0 = _mm_cmplt_pd(a0, b0);  c1 = _mm_cmplt_pd(a1, b1); }
+			else if constexpr (OP == comparison_t::LESS_EQUAL) { c0 = _mm_cmple_pd(a0, b0); c1 = _mm_cmple_pd(a1, b1); }
+			else if constexpr (OP == comparison_t::GREATER)    { c0 = _mm_cmpgt_pd(a0, b0);  c1 = _mm_cmpgt_pd(a1, b1); }
+			else                                               { c0 = _mm_cmpge_pd(a0, b0);  c1 = _mm_cmpge_pd(a1, b1); }
+
+			const auto bits = _mm_movemask_pd(c0) | (_mm_movemask_pd(c1) << 2);
+			result |= static_cast<std::uint64_t>(bits) << i;
+		}
+#else
+		for (std::size_t i = 0; i < ROWS; i++) {
+			const auto a = lhs[i];
+			const auto b = rhs ? rhs[i] : value;
+			bool match;
+			if constexpr (OP == comparison_t::EQUAL)           match = a == b;
+			else if constexpr (OP == comparison_t::NOT_EQUAL)  match = a != b;
+			else if constexpr (OP == comparison_t::LESS)       match = a < b;
+			else if constexpr (OP == comparison_t::LESS_EQUAL) match = a <= b;
+			else if constexpr (OP == comparison_t::GREATER)    match = a > b;
+			else                                               match = a >= b;
+
+			result |= static_cast<std::uint64_t>(match) << i;
+		}
+#endif
+		return result;
+	}
+
+	// bit i of the result is set if ids[i] == id
+	std::uint64_t ScanIds(const ServerStore::value_id_t* ids, ServerStore::value_id_t id) noexcept
+	{
+		static constexpr std::size_t ROWS = ServerStore::PAGE_SIZE;
+		auto result = std::uint64_t{ 0 };
+#if defined(GAMESPY_FILTER_SSE2)
+		const auto broadcast = _mm_set1_epi16(static_cast<short>(id));
+		for (std::size_t i = 0; i < ROWS; i += 16) {
+			const auto c0 = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ids + i)), broadcast);
+			const auto c1 = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ids + i + 8)), broadcast);
+			// the 16-bit masks are packed to bytes (saturation keeps 0xFFFF as 0xFF)
+			const auto bits = _mm_movemask_epi8(_mm_packs_epi16(c0, c1));
+			result |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(bits)) << i;
+		}
+#else
+		for (std::size_t i = 0; i < ROWS; i++)
+			result |= static_cast<std::uint64_t>(ids[i] == id) << i;
+#endif
+		return result;
+	}
+}
+
+std::expected<ServerFilter, ServerFilter::ParseError> ServerFilter::Compile(const std::string_view& filter, const resolver_t& resolve)
+{
+	auto result = ServerFilter{};
+	auto parser = Parser{ filter, resolve, result };
+	if (auto parsed = parser.Parse(); !parsed)
+		return std::unexpected(parsed.error());
+
+	return result;
+}
+
+std::uint64_t ServerFilter::Select(const ServerStore::Snapshot& store, std::size_t page, std::uint64_t candidates) const
+{
+	const auto rows = store.GetUsedRows(page) & candidates;
+	if (!rows)
+		return 0;
+
+	return Evaluate(m_Nodes.back(), store, page, rows);
+}
+
+template<typename F>
+bool ServerFilter::ForEachIndexedRow(const node_t& node, const ServerStore::Snapshot& store, F&& f) const
+{
+	if (node.op > opcode_t::GREATER_EQUAL || node.lhs.is_column == node.rhs.is_column)
+		return false;
+
+	// column <op> literal
+	auto op = node.op;
+	auto column = &node.lhs, literal = &node.rhs;
+	if (!column->is_column) {
+		std::swap(column, literal);
+		op = Mirror(op);
+	}
+
+	const auto& info = store.GetColumns()[column->column];
+	if (info.index_type == ServerStore::IndexType::HASH && op == opcode_t::EQUAL && !node.numeric) {
+		for (const auto row : store.FindRows(info, m_Literals[literal->literal].text)) {
+			if (!f(row))
+				break;
+		}
+
+		return true;
+	}
+
+	if (info.index_type != ServerStore::IndexType::ORDERED || !node.scan || op == opcode_t::NOT_EQUAL)
+		return false;
+
+	const auto index = store.GetOrderedIndex(info);
+	const auto value = *m_Literals[literal->literal].number;
+	const auto lower = [&] { return std::ranges::lower_bound(index, std::make_pair(value, ServerStore::row_t{ 0 })); };
+	const auto upper = [&] { return std::ranges::upper_bound(index, std::make_pair(value, ServerStore::NO_ROW)); };
+	auto first = index.begin(), last = index.end();
+	switch (op) {
+	case opcode_t::EQUAL:         first = lower(); last = upper(); break;
+	case opcode_t::LESS:          last = lower(); break;
+	case opcode_t::LESS_EQUAL:    last = upper(); break;
+	case opcode_t::GREATER:       first = upper(); break;
+	default:                      first = lower(); break;
+	}
+
+	for (; first != last; ++first) {
+		if (!f(first->second))
+			return true;
+	}
+
+	// values which are not numbers are greater than any number (and are not part of the index)
+	if (op == opcode_t::GREATER || op == opcode_t::GREATER_EQUAL) {
+		for (std::size_t page = 0; page < store.GetPageCount(); page++) {
+			for (auto rows = store.GetNonNumbers(page, info) & store.GetUsedRows(page); rows; rows &= rows - 1) {
+				if (!f(static_cast<ServerStore::row_t>(page * ServerStore::PAGE_SIZE + std::countr_zero(rows))))
+					return true;
+			}
+		}
+	}
+
+	return true;
+}
+
+std::optional<std::vector<std::uint64_t>> ServerFilter::FindCandidates(const ServerStore::Snapshot& store) const
+{
+	// comparisons which have to be true for every match: the root itself or the operands of the root AND
+	const auto& root = m_Nodes.back();
+	auto predicates = std::vector<const node_t*>{ &root };
+	if (root.op == opcode_t::AND) {
+		predicates.clear();
+		for (const auto child : root.children)
+			predicates.push_back(&m_Nodes[child]);
+	}
+
+	// the rows of the indexes are only counted up to the limit, so estimating the selectivity is cheap
+	const auto limit = store.size() / MIN_INDEX_SELECTIVITY;
+	const node_t* best = nullptr;
+	auto bestRows = limit + 1;
+	for (const auto predicate : predicates) {
+		auto rows = std::size_t{ 0 };
+		const auto indexed = ForEachIndexedRow(*predicate, store, [&](ServerStore::row_t) { return ++rows < bestRows; });
+		if (indexed && rows < bestRows) {
+			best = predicate;
+			bestRows = rows;
+		}
+	}
+
+	if (!best)
+		return std::nullopt;
+
+	// the indexes of the snapshot might not contain the current values of the rows which changed since they were copied
+	auto candidates = std::vector<std::uint64_t>(store.GetPageCount());
+	for (std::size_t page = 0; page < candidates.size(); page++)
+		candidates[page] = store.GetUnindexedRows(page);
+
+	ForEachIndexedRow(*best, store, [&](ServerStore::row_t row) {
+		candidates[row / ServerStore::PAGE_SIZE] |= std::uint64_t{ 1 } << (row % ServerStore::PAGE_SIZE);
+		return true;
+	});
+
+	return candidates;
+}
+
+std::uint64_t ServerFilter::Evaluate(const node_t& node, const ServerStore::Snapshot& store, std::size_t page, std::uint64_t rows) const
+{
+	switch (node.op) {
+	case opcode_t::AND:
+		for (const auto child : node.children) {
+			if (!rows)
+				break;
+
+			rows = Evaluate(m_Nodes[child], store, page, rows);
+		}
+
+		return rows;
+
+	case opcode_t::OR: {
+		auto matches = std::uint64_t{ 0 };
+		for (const auto child : node.children) {
+			if (!rows)
+				break;
+
+			const auto childMatches = Evaluate(m_Nodes[child], store, page, rows);
+			matches |= childMatches;
+			rows &= ~childMatches;
+		}
+
+		return matches;
+	}
+
+	case opcode_t::NOT:
+		return rows & ~Evaluate(m_Nodes[node.children.front()], store, page, rows);
+
+	default:
+		break;
+	}
+
+	auto matches = std::uint64_t{ 0 };
+	auto remaining = rows;
+	if (node.interned) {
+		matches = ScanInterned(node, store, page, remaining) & rows;
+		remaining &= rows;
+	}
+	else if (node.scan) {
+		// rows whose values are not numbers are compared one by one
+		const auto& columns = store.GetColumns();
+		remaining = node.lhs.is_column ? store.GetNonNumbers(page, columns[node.lhs.column]) : 0;
+		if (node.rhs.is_column)
+			remaining |= store.GetNonNumbers(page, columns[node.rhs.column]);
+
+		remaining &= rows;
+		matches = Scan(node, store, page) & rows & ~remaining;
+	}
+
+	for (; remaining; remaining &= remaining - 1) {
+		const auto pos = std::countr_zero(remaining);
+		if (Compare(node, store, static_cast<ServerStore::row_t>(page * ServerStore::PAGE_SIZE + pos)))
+			matches |= std::uint64_t{ 1 } << pos;
+	}
+
+	return matches;
+}
+
+std::uint64_t ServerFilter::Scan(const node_t& node, const ServerStore::Snapshot& store, std::size_t page) const
+{
+	const auto& columns = store.GetColumns();
+	auto op = node.op;
+	auto lhs = &node.lhs, rhs = &node.rhs;
+	if (!lhs->is_column) {
+		std::swap(lhs, rhs);
+		op = Mirror(op);
+	}
+
+	const auto lhsNumbers = store.GetNumbers(page, columns[lhs->column]).data();
+	const auto rhsNumbers = rhs->is_column ? store.GetNumbers(page, columns[rhs->column]).data() : nullptr;
+	const auto value = rhs->is_column ? 0.0 : *m_Literals[rhs->literal].number;
+	switch (op) {
+	case opcode_t::EQUAL:         return ScanNumbers<comparison_t::EQUAL>(lhsNumbers, rhsNumbers, value);
+	case opcode_t::NOT_EQUAL:     return ScanNumbers<comparison_t::NOT_EQUAL>(lhsNumbers, rhsNumbers, value);
+	case opcode_t::LESS:          return ScanNumbers<comparison_t::LESS>(lhsNumbers, rhsNumbers, value);
+	case opcode_t::LESS_EQUAL:    return ScanNumbers<comparison_t::LESS_EQUAL>(lhsNumbers, rhsNumbers, value);
+	case opcode_t::GREATER:       return ScanNumbers<comparison_t::GREATER>(lhsNumbers, rhsNumbers, value);
+	default:                      return ScanNumbers<comparison_t::GREATER_EQUAL>(lhsNumbers, rhsNumbers, value);
+	}
+}
+
+std::uint64_t ServerFilter::ScanInterned(const node_t& node, const ServerStore::Snapshot& store, std::size_t page, std::uint64_t& remaining) const
+{
+	const auto& column = node.lhs.is_column ? node.lhs : node.rhs;
+	const auto& literal = node.lhs.is_column ? node.rhs : node.lhs;
+	const auto& info = store.GetColumns()[column.column];
+
+	// rows whose values are not interned are compared one by one
+	const auto ids = store.GetValueIds(page, info).data();
+	remaining = ScanIds(ids, ServerStore::NO_VALUE_ID);
+
+	// a value which is not interned only matches rows whose values are not interned either
+	const auto id = store.FindValueId(info, m_Literals[literal.literal].text);
+	const auto equal = id ? ScanIds(ids, *id) : 0;
+	return (node.op == opcode_t::EQUAL ? equal : ~equal) & ~remaining;
+}
+
+bool ServerFilter::Compare(const node_t& node, const ServerStore::Snapshot& store, ServerStore::row_t row) const
+{
+	const auto text = [&](const operand_t& operand) -> std::string_view {
+		return operand.is_column ? store.Get(row, operand.column) : std::string_view{ m_Literals[operand.literal].text };
+	};
+
+	if (node.op == opcode_t::LIKE || node.op == opcode_t::NOT_LIKE)
+		return Like(text(node.lhs), text(node.rhs)) == (node.op == opcode_t::LIKE);
+
+	const auto number = [&](const operand_t& operand) -> std::optional<double> {
+		return operand.is_column ? ServerStore::ParseNumber(store.Get(row, operand.column)) : m_Literals[operand.literal].number;
+	};
+
+	auto order = std::partial_ordering::equivalent;
+	if (!node.numeric)
+		order = text(node.lhs) <=> text(node.rhs);
+	else {
+		// values which are not numbers are greater than any number
+		const auto lhs = number(node.lhs);
+		const auto rhs = number(node.rhs);
+		if (lhs && rhs)
+			order = *lhs <=> *rhs;
+		else if (lhs || rhs)
+			order = lhs ? std::partial_ordering::less : std::partial_ordering::greater;
+		else
+			order = text(node.lhs) <=> text(node.rhs);
+	}
+
+	switch (node.op) {
+	case opcode_t::EQUAL:         return order == 0;
+	case opcode_t::NOT_EQUAL:     return order != 0;
+	case opcode_t::LESS:          return order < 0;
+	case opcode_t::LESS_EQUAL:    return order <= 0;
+	case opcode_t::GREATER:       return order > 0;
+	default:                      return order >= 0;
+	}
+}
+
+bool ServerFilter::Like(const std::string_view& value, const std::string_view& pattern) noexcept
+{
+	// greedy matching which backtracks to the last % only
+	std::size_t v = 0, p = 0;
+	std::size_t star = std::string_view::npos, starValue = 0;
+	while (v < value.size()) {
+		if (p < pattern.size() && pattern[p] == '%') {
+			star = p++;
+			starValue = v;
+		}
+		else if (p < pattern.size() && (pattern[p] == '_' || std::tolower(static_cast<unsigned char>(pattern[p])) == std::tolower(static_cast<unsigned char>(value[v])))) {
+			p++;
+			v++;
+		}
+		else if (star != std::string_view::npos) {
+			p = star + 1;
+			v = ++starValue;
+		}
+		else
+			return false;
+	}
+
+	while (p < pattern.size() && pattern[p] == '%')
+		p++;
+
+	return p == pattern.size();
+}
@@ -0,0 +1,124 @@
+#pragma once
+#ifndef _GAMESPY_SERVERFILTER_H_
+#define _GAMESPY_SERVERFILTER_H_
+
+#include "serverstore.h"
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gamespy {
+	// compiled server filter of a browser query, e.g. "gamever='1.5' and numplayers>0 and not (hostname like '%test%')"
+	// grammar (keywords are case-insensitive):
+	//   expr       := and { OR and }
+	//   and        := not { AND not }
+	//   not        := NOT not | '(' expr ')' | comparison
+	//   comparison := operand ( ('=' | '==' | '!=' | '<>' | '<' | '<=' | '>' | '>=') operand | [NOT] LIKE operand )
+	//   operand    := column | 'string' | "string" | number
+	// the filter is compiled to a tree which is evaluated directly against the pages of a ServerStore::Snapshot:
+	// - every node yields the bitmap of the matching rows of a page, AND/OR/NOT combine those bitmaps
+	// - the children of AND/OR are only evaluated for the rows which are still undecided (short-circuit)
+	// - comparisons of numeric columns with numbers scan the whole column of the page (simd), so do (in)equalities of other columns
+	//   with strings: they compare the ids of the interned values, only the values which are not interned are compared as strings
+	// - other comparisons are evaluated row by row
+	// - a selective comparison which has to be true for every match (e.g. mapname='x' and ...) may use an index of its column,
+	//   then only the pages and rows found by the index (and the rows which changed since the snapshot copied the indexes) are evaluated
+	// comparisons follow sqlite's rules (as the filters used to be evaluated by sqlite):
+	// - values are compared as numbers if one side is a numeric column, otherwise as strings (binary)
+	// - for numeric comparisons, values which are not numbers are greater than all numbers
+	// - two literals are only compared as numbers if neither of them is quoted
+	// - LIKE is case-insensitive (ascii) and supports the wildcards % and _
+	class ServerFilter {
+	public:
+		static constexpr std::size_t MAX_DEPTH = 32; // nested parentheses and NOTs
+		static constexpr std::size_t MIN_INDEX_SELECTIVITY = 32; // indexes are only used if they match at most 1/32 of the servers (scans are cheap)
+
+		enum class ParseError {
+			UNEXPECTED_TOKEN,
+			UNEXPECTED_END,
+			UNTERMINATED_STRING,
+			UNKNOWN_COLUMN,
+			TOO_DEEP
+		};
+
+		struct ColumnInfo {
+			ServerStore::column_t column;
+			bool numeric; // INTEGER or FLOAT (the store keeps the numbers of the column)
+		};
+
+		// resolves the column names of the filter, std::nullopt for unknown columns
+		using resolver_t = std::function<std::optional<ColumnInfo>(const std::string_view& name)>;
+
+	private:
+		enum class opcode_t : std::uint8_t {
+			EQUAL,
+			NOT_EQUAL,
+			LESS,
+			LESS_EQUAL,
+			GREATER,
+			GREATER_EQUAL,
+			LIKE,
+			NOT_LIKE,
+			NOT,
+			AND,
+			OR
+		};
+
+		struct operand_t {
+			bool is_column = false;
+			bool numeric = false; // numeric column or a literal which is a number
+			ServerStore::column_t column = 0;
+			std::uint32_t literal = 0; // index into m_Literals
+		};
+
+		struct node_t {
+			opcode_t op = opcode_t::EQUAL;
+			bool numeric = false; // comparison of numbers
+			bool scan = false; // numeric comparison of a column with a number or another numeric column
+			bool interned = false; // (in)equality of a column which is not numeric with a literal (compares the ids of the interned values)
+			operand_t lhs = {};
+			operand_t rhs = {};
+			std::vector<std::uint32_t> children = {}; // AND, OR, NOT
+		};
+
+		struct literal_t {
+			std::string text;
+			std::optional<double> number; // also set for strings like '10' (which are numbers when compared to numeric columns)
+			bool quoted = false;
+		};
+
+		std::vector<node_t> m_Nodes; // children precede their parents, so the root is the last node
+		std::vector<literal_t> m_Literals;
+
+		class Parser;
+
+		std::uint64_t Evaluate(const node_t& node, const ServerStore::Snapshot& store, std::size_t page, std::uint64_t rows) const;
+		std::uint64_t Scan(const node_t& node, const ServerStore::Snapshot& store, std::size_t page) const;
+		std::uint64_t ScanInterned(const node_t& node, const ServerStore::Snapshot& store, std::size_t page, std::uint64_t& remaining) const;
+		bool Compare(const node_t& node, const ServerStore::Snapshot& store, ServerStore::row_t row) const;
+
+		// calls f(row) for the rows of the index of the comparison until f returns false,
+		// returns false if the comparison can not be answered by an index
+		template<typename F>
+		bool ForEachIndexedRow(const node_t& node, const ServerStore::Snapshot& store, F&& f) const;
+
+	public:
+		static std::expected<ServerFilter, ParseError> Compile(const std::string_view& filter, const resolver_t& resolve);
+
+		// bitmaps of the candidate rows of every page, if an index narrows down the rows which might match
+		// (std::nullopt if all rows have to be evaluated)
+		std::optional<std::vector<std::uint64_t>> FindCandidates(const ServerStore::Snapshot& store) const;
+
+		// bitmap of the rows of the page which match the filter (see ServerStore::Snapshot::GetUsedRows),
+		// only the rows of `candidates` are evaluated
+		std::uint64_t Select(const ServerStore::Snapshot& store, std::size_t page, std::uint64_t candidates = ~std::uint64_t{ 0 }) const;
+
+		static bool Like(const std::string_view& value, const std::string_view& pattern) noexcept;
+	};
+}
+
+#endif
@@ -0,0 +1,535 @@
+#include "serverstore.h"
+#include <algorithm>
+#include <charconv>
+#include <cctype>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+using namespace gamespy;
+
+ServerStore::ServerStore()
+	: m_Columns{ std::make_shared<const std::vector<Column>>() }, m_Index(64)
+{
+
+}
+
+ServerStore::~ServerStore()
+{
+
+}
+
+std::optional<ServerStore::column_t> ServerStore::FindColumn(const std::string_view& name) const
+{
+	const auto iter = m_ColumnIds.find(name);
+	if (iter == m_ColumnIds.end())
+		return std::nullopt;
+
+	return iter->second;
+}
+
+ServerStore::column_t ServerStore::AddColumn(const std::string_view& name, const std::string_view& defaultValue, bool numeric, IndexType indexType)
+{
+	if (const auto column = FindColumn(name))
+		return *column;
+
+	if (indexType == IndexType::ORDERED && !numeric)
+		throw std::invalid_argument{ "ordered indexes require a numeric column" };
+	if (indexType != IndexType::NONE && m_IndexedColumns.size() >= MAX_INDEXES)
+		throw std::length_error{ "too many indexes" };
+
+	auto index = std::size_t{ 0 };
+	if (indexType == IndexType::HASH) {
+		index = m_HashIndexes.size();
+		m_HashIndexes.emplace_back();
+	}
+	else if (indexType == IndexType::ORDERED) {
+		index = m_OrderedIndexes++;
+	}
+
+	// snapshots keep the columns they were published with
+	const auto column = m_Columns->size();
+	const auto numbers = numeric ? std::optional<std::size_t>{ m_NumericColumns++ } : std::nullopt;
+	const auto interned = numeric ? std::nullopt : std::optional<std::size_t>{ m_Dictionaries.size() };
+	if (interned)
+		m_Dictionaries.push_back(std::make_shared<dictionary_t>());
+
+	auto columns = std::make_shared<std::vector<Column>>(*m_Columns);
+	columns->push_back(Column{ .name = std::string{ name }, .default_value = std::string{ defaultValue }, .numbers = numbers, .interned = interned, .index_type = indexType, .index = index });
+	m_Columns = std::move(columns);
+	m_ColumnIds.emplace(name, column);
+	if (indexType != IndexType::NONE) {
+		m_IndexedColumns.push_back(column);
+		m_PublishedIndexes.reset(); // the copy lacks the new index
+	}
+
+	// existing servers did not send this value yet (the default value is the first one which is interned)
+	const auto defaultId = interned ? Intern(*interned, defaultValue) : NO_VALUE_ID;
+	for (std::size_t p = 0; p < m_Pages.size(); p++) {
+		auto& page = MutablePage(p);
+		auto& ends = page.ends.emplace_back();
+		if (numbers) {
+			page.numbers.emplace_back();
+			page.non_numbers.emplace_back();
+		}
+		if (interned)
+			page.ids.emplace_back().fill(defaultId);
+
+		for (auto used = page.used; used; used &= used - 1) {
+			const auto pos = std::countr_zero(used);
+			auto& values = page.values[pos];
+			const auto promoted = page.overflow[pos].empty() ? std::nullopt : TakeOverflow(page.overflow[pos], name);
+			const auto value = std::string_view{ promoted ? *promoted : defaultValue }.substr(0, MAX_ROW_SIZE - values.size());
+			const auto id = promoted && interned ? Intern(*interned, value) : defaultId;
+			if (interned)
+				page.ids.back()[pos] = id;
+			if (id == NO_VALUE_ID)
+				values.append(value);
+			ends[pos] = static_cast<std::uint16_t>(values.size());
+			if (numbers)
+				SetNumber(page, pos, *numbers, value);
+			if (indexType != IndexType::NONE)
+				AddToIndex(static_cast<row_t>(p * PAGE_SIZE + pos), column);
+			page.versions[pos] = ++m_Version;
+		}
+	}
+
+	return column;
+}
+
+std::optional<std::string_view> ServerStore::FindOverflow(const std::string& overflow, const std::string_view& key) noexcept
+{
+	auto found = std::optional<std::string_view>{};
+	VisitOverflow(overflow, [&](const std::string_view& name, const std::string_view& value) {
+		if (name == key)
+			found = value;
+
+		return !found;
+	});
+
+	return found;
+}
+
+std::optional<std::string> ServerStore::TakeOverflow(std::string& overflow, const std::string_view& key)
+{
+	auto begin = std::size_t{ 0 };
+	auto taken = std::optional<std::string>{};
+	VisitOverflow(overflow, [&](const std::string_view& name, const std::string_view& value) {
+		const auto length = name.size() + value.size() + 2;
+		if (name != key) {
+			begin += length;
+			return true;
+		}
+
+		taken.emplace(value);
+		overflow.erase(begin, length);
+		return false;
+	});
+
+	return taken;
+}
+
+void ServerStore::SetOverflow(row_t row, const std::span<const std::pair<std::string_view, std::string_view>>& values)
+{
+	m_OverflowBuffer.clear();
+	for (const auto& [key, value] : values) {
+		if (m_OverflowBuffer.size() + key.size() + value.size() + 2 > MAX_OVERFLOW_SIZE)
+			continue;
+
+		m_OverflowBuffer.append(key);
+		m_OverflowBuffer.push_back('\0');
+		m_OverflowBuffer.append(value);
+		m_OverflowBuffer.push_back('\0');
+	}
+
+	// most heartbeats repeat the previous values
+	if (Page(row).overflow[row % PAGE_SIZE] != m_OverflowBuffer) {
+		auto& page = MutablePage(row / PAGE_SIZE);
+		page.overflow[row % PAGE_SIZE] = m_OverflowBuffer;
+		page.versions[row % PAGE_SIZE] = ++m_Version;
+	}
+}
+
+std::optional<double> ServerStore::ParseNumber(std::string_view value) noexcept
+{
+	while (!value.empty() && std::isspace(static_cast<unsigned char>(value.front())))
+		value.remove_prefix(1);
+	while (!value.empty() && std::isspace(static_cast<unsigned char>(value.back())))
+		value.remove_suffix(1);
+
+	if (!value.empty() && value.front() == '+')
+		value.remove_prefix(1);
+
+	double number = 0.0;
+	const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), number);
+	if (value.empty() || ec != std::errc{} || end != value.data() + value.size())
+		return std::nullopt;
+
+	return number;
+}
+
+void ServerStore::SetNumber(page_t& page, std::size_t pos, std::size_t numbers, const std::string_view& value) noexcept
+{
+	const auto number = ParseNumber(value);
+	const auto bit = std::uint64_t{ 1 } << pos;
+	page.numbers[numbers][pos] = number.value_or(std::numeric_limits<double>::quiet_NaN());
+	page.non_numbers[numbers] = number ? page.non_numbers[numbers] & ~bit : page.non_numbers[numbers] | bit;
+}
+
+ServerStore::value_id_t ServerStore::Intern(std::size_t interned, const std::string_view& value)
+{
+	if (const auto iter = m_Dictionaries[interned]->ids.find(value); iter != m_Dictionaries[interned]->ids.end())
+		return iter->second;
+
+	if (m_Dictionaries[interned]->values.size() >= MAX_INTERNED_VALUES)
+		return NO_VALUE_ID;
+
+	// snapshots keep the dictionary they were published with (they never refer to the new value)
+	if (m_Dictionaries[interned].use_count() > 1)
+		m_Dictionaries[interned] = std::make_shared<dictionary_t>(*m_Dictionaries[interned]);
+
+	auto& dictionary = *m_Dictionaries[interned];
+	const auto id = static_cast<value_id_t>(dictionary.values.size());
+	dictionary.values.emplace_back(value);
+	dictionary.ids.emplace(value, id);
+	return id;
+}
+
+ServerStore::page_t& ServerStore::MutablePage(std::size_t page)
+{
+	// the page is part of a snapshot (only snapshots share pages), which must not see the change
+	if (m_Pages[page].use_count() > 1)
+		m_Pages[page] = std::make_shared<page_t>(*m_Pages[page]);
+
+	return *m_Pages[page];
+}
+
+void ServerStore::Rehash(std::size_t slots)
+{
+	auto index = std::vector<slot_t>(slots);
+	std::swap(index, m_Index);
+	for (const auto& slot : index) {
+		if (slot.row == NO_ROW)
+			continue;
+
+		auto pos = Slot(slot.key);
+		while (m_Index[pos].row != NO_ROW)
+			pos = (pos + 1) & (m_Index.size() - 1);
+
+		m_Index[pos] = slot;
+	}
+}
+
+ServerStore::row_t ServerStore::Find(std::uint32_t ip, std::uint16_t port) const noexcept
+{
+	const auto key = Key(ip, port);
+	for (auto pos = Slot(key); m_Index[pos].row != NO_ROW; pos = (pos + 1) & (m_Index.size() - 1)) {
+		if (m_Index[pos].key == key)
+			return m_Index[pos].row;
+	}
+
+	return NO_ROW;
+}
+
+ServerStore::row_t ServerStore::Insert(std::uint32_t ip, std::uint16_t port)
+{
+	if (const auto row = Find(ip, port); row != NO_ROW)
+		return row;
+
+	if ((m_Size + 1) * 2 > m_Index.size())
+		Rehash(m_Index.size() * 2);
+
+	row_t row = NO_ROW;
+	if (!m_FreeRows.empty()) {
+		row = m_FreeRows.back();
+		m_FreeRows.pop_back();
+	}
+	else {
+		if (m_Pages.size() * PAGE_SIZE >= NO_ROW)
+			throw std::overflow_error{ "too many servers" };
+
+		auto& page = m_Pages.emplace_back(std::make_shared<page_t>());
+		page->ends.resize(m_Columns->size());
+		page->numbers.resize(m_NumericColumns);
+		page->non_numbers.resize(m_NumericColumns);
+		page->ids.resize(m_Dictionaries.size());
+		m_Unindexed.push_back(0);
+		row = static_cast<row_t>((m_Pages.size() - 1) * PAGE_SIZE);
+		for (auto free = row + PAGE_SIZE - 1; free > row; free--)
+			m_FreeRows.push_back(static_cast<row_t>(free));
+	}
+
+	auto& page = MutablePage(row / PAGE_SIZE);
+	const auto pos = row % PAGE_SIZE;
+	page.ip[pos] = ip;
+	page.port[pos] = port;
+	page.last_update[pos] = {};
+	Assign(row, [this](column_t column) -> std::string_view { return (*m_Columns)[column].default_value; });
+	page.used |= std::uint64_t{ 1 } << pos;
+
+	const auto key = Key(ip, port);
+	auto slot = Slot(key);
+	while (m_Index[slot].row != NO_ROW)
+		slot = (slot + 1) & (m_Index.size() - 1);
+
+	m_Index[slot] = slot_t{ .key = key, .row = row };
+	m_Size++;
+	return row;
+}
+
+bool ServerStore::Erase(std::uint32_t ip, std::uint16_t port)
+{
+	const auto key = Key(ip, port);
+	const auto mask = m_Index.size() - 1;
+	auto pos = Slot(key);
+	while (m_Index[pos].row != NO_ROW && m_Index[pos].key != key)
+		pos = (pos + 1) & mask;
+
+	if (m_Index[pos].row == NO_ROW)
+		return false;
+
+	const auto row = m_Index[pos].row;
+	for (const auto column : m_IndexedColumns)
+		RemoveFromIndex(row, column);
+
+	auto& page = MutablePage(row / PAGE_SIZE);
+	page.used &= ~(std::uint64_t{ 1 } << (row % PAGE_SIZE));
+	page.values[row % PAGE_SIZE] = std::string{};
+	page.overflow[row % PAGE_SIZE] = std::string{};
+	m_FreeRows.push_back(row);
+	m_Size--;
+
+	// backward shift deletion: entries which were displaced by the erased one are moved up, so no tombstones are required
+	for (auto next = (pos + 1) & mask; m_Index[next].row != NO_ROW; next = (next + 1) & mask) {
+		const auto home = Slot(m_Index[next].key);
+		if (((next - home) & mask) >= ((next - pos) & mask)) {
+			m_Index[pos] = m_Index[next];
+			pos = next;
+		}
+	}
+
+	m_Index[pos] = slot_t{};
+	return true;
+}
+
+void ServerStore::Set(row_t row, column_t column, const std::string_view& value)
+{
+	const auto& columns = *m_Columns;
+	auto& page = MutablePage(row / PAGE_SIZE);
+	const auto pos = row % PAGE_SIZE;
+	const auto indexed = columns[column].index_type != IndexType::NONE && ((page.used >> pos) & 1);
+	if (indexed)
+		RemoveFromIndex(row, column);
+
+	auto& values = page.values[pos];
+	const std::size_t begin = column ? page.ends[column - 1][pos] : 0;
+	const std::size_t length = page.ends[column][pos] - begin;
+	auto replacement = value.substr(0, MAX_ROW_SIZE - (values.size() - length));
+	const auto& interned = columns[column].interned;
+	if (interned) {
+		auto& id = page.ids[*interned][pos];
+		id = Intern(*interned, replacement);
+		if (id != NO_VALUE_ID)
+			replacement = {};
+	}
+	values.replace(begin, length, replacement);
+
+	// the values of the following columns moved
+	for (auto next = column; next < columns.size(); next++)
+		page.ends[next][pos] = static_cast<std::uint16_t>(page.ends[next][pos] - length + replacement.size());
+
+	if (columns[column].numbers)
+		SetNumber(page, pos, *columns[column].numbers, replacement);
+	if (indexed)
+		AddToIndex(row, column);
+	page.versions[pos] = ++m_Version;
+}
+
+void ServerStore::MarkUnindexed(row_t row) noexcept
+{
+	const auto bit = std::uint64_t{ 1 } << (row % PAGE_SIZE);
+	if (!(m_Unindexed[row / PAGE_SIZE] & bit)) {
+		m_Unindexed[row / PAGE_SIZE] |= bit;
+		m_UnindexedRows++;
+	}
+}
+
+void ServerStore::AddToIndex(row_t row, column_t column)
+{
+	// the copy of the indexes misses the row until it is copied again (ordered indexes only exist as copies)
+	MarkUnindexed(row);
+	const auto& info = (*m_Columns)[column];
+	if (info.index_type == IndexType::HASH) {
+		auto& index = m_HashIndexes[info.index];
+		if (index.positions.size() <= row)
+			index.positions.resize(m_Pages.size() * PAGE_SIZE);
+
+		const auto value = Get(row, column);
+		auto rows = index.rows.find(value);
+		if (rows == index.rows.end())
+			rows = index.rows.emplace(std::string{ value }, std::vector<row_t>{}).first;
+
+		index.positions[row] = static_cast<std::uint32_t>(rows->second.size());
+		rows->second.push_back(row);
+	}
+}
+
+void ServerStore::RemoveFromIndex(row_t row, column_t column)
+{
+	MarkUnindexed(row);
+	const auto& info = (*m_Columns)[column];
+	if (info.index_type == IndexType::HASH) {
+		auto& index = m_HashIndexes[info.index];
+		const auto rows = index.rows.find(Get(row, column));
+		if (rows == index.rows.end())
+			return;
+
+		// the last row takes the place of the removed one
+		const auto position = index.positions[row];
+		const auto last = rows->second.back();
+		rows->second[position] = last;
+		index.positions[last] = position;
+		rows->second.pop_back();
+
+		// values of high cardinality (e.g. hostname) must not accumulate
+		if (rows->second.empty())
+			index.rows.erase(rows);
+	}
+}
+
+ServerStore::ordered_rows_t ServerStore::CopyOrderedIndex(const Column& column, const ordered_rows_t* previous) const
+{
+	// only the rows which changed since the previous copy are sorted, they are merged with the unchanged rows
+	auto changed = ordered_rows_t{};
+	for (std::size_t p = 0; p < m_Pages.size(); p++) {
+		const auto& page = *m_Pages[p];
+		auto rows = page.used & ~page.non_numbers[*column.numbers];
+		if (previous)
+			rows &= m_Unindexed[p];
+
+		for (; rows; rows &= rows - 1) {
+			const auto pos = std::countr_zero(rows);
+			changed.emplace_back(page.numbers[*column.numbers][pos], static_cast<row_t>(p * PAGE_SIZE + pos));
+		}
+	}
+
+	std::ranges::sort(changed);
+	if (!previous)
+		return changed;
+
+	auto unchanged = ordered_rows_t{};
+	unchanged.reserve(previous->size());
+	std::ranges::copy_if(*previous, std::back_inserter(unchanged), [this](const ordered_rows_t::value_type& entry) {
+		return !((m_Unindexed[entry.second / PAGE_SIZE] >> (entry.second % PAGE_SIZE)) & 1);
+	});
+
+	auto rows = ordered_rows_t{};
+	rows.reserve(unchanged.size() + changed.size());
+	std::ranges::merge(unchanged, changed, std::back_inserter(rows));
+	return rows;
+}
+
+std::shared_ptr<const ServerStore::Snapshot> ServerStore::Publish()
+{
+	// the indexes are only copied once enough rows changed
+	// (until then, filters evaluate the unindexed rows in addition to the rows found by the indexes)
+	if (!m_IndexedColumns.empty() && (!m_PublishedIndexes || m_UnindexedRows > m_Size / UNINDEXED_RATIO)) {
+		auto indexes = std::make_shared<indexes_t>();
+		for (const auto& index : m_HashIndexes)
+			indexes->hash.push_back(index.rows);
+
+		indexes->ordered.resize(m_OrderedIndexes);
+		for (const auto column : m_IndexedColumns) {
+			const auto& info = (*m_Columns)[column];
+			if (info.index_type == IndexType::ORDERED)
+				indexes->ordered[info.index] = CopyOrderedIndex(info, m_PublishedIndexes ? &m_PublishedIndexes->ordered[info.index] : nullptr);
+		}
+
+		m_PublishedIndexes = std::move(indexes);
+		std::ranges::fill(m_Unindexed, std::uint64_t{ 0 });
+		m_UnindexedRows = 0;
+	}
+
+	auto snapshot = std::make_shared<Snapshot>();
+	snapshot->m_Columns = m_Columns;
+	snapshot->m_Pages.assign(m_Pages.begin(), m_Pages.end());
+	snapshot->m_Dictionaries.assign(m_Dictionaries.begin(), m_Dictionaries.end());
+	snapshot->m_Indexes = m_PublishedIndexes;
+	snapshot->m_Unindexed = m_Unindexed;
+	snapshot->m_Size = m_Size;
+	return snapshot;
+}
+
+std::optional<ServerStore::column_t> ServerStore::Snapshot::FindColumn(const std::string_view& name) const noexcept
+{
+	const auto& columns = *m_Columns;
+	for (column_t column = 0; column < columns.size(); column++) {
+		if (columns[column].name == name)
+			return column;
+	}
+
+	return std::nullopt;
+}
+
+std::optional<ServerStore::value_id_t> ServerStore::Snapshot::FindValueId(const Column& column, const std::string_view& value) const noexcept
+{
+	const auto& ids = m_Dictionaries[*column.interned]->ids;
+	const auto iter = ids.find(value);
+	if (iter == ids.end())
+		return std::nullopt;
+
+	return iter->second;
+}
+
+std::span<const ServerStore::row_t> ServerStore::Snapshot::FindRows(const Column& column, const std::string_view& value) const
+{
+	const auto& index = m_Indexes->hash[column.index];
+	const auto rows = index.find(value);
+	if (rows == index.end())
+		return {};
+
+	return rows->second;
+}
+
+std::size_t ServerStore::GetMemoryUsage() const noexcept
+{
+	auto usage = sizeof(*this) + m_Index.capacity() * sizeof(slot_t) + m_FreeRows.capacity() * sizeof(row_t) + m_Unindexed.capacity() * sizeof(std::uint64_t);
+	for (const auto& index : m_HashIndexes) {
+		usage += index.positions.capacity() * sizeof(std::uint32_t) + index.rows.bucket_count() * sizeof(void*);
+		for (const auto& [value, rows] : index.rows)
+			usage += sizeof(std::pair<const std::string, std::vector<row_t>>) + 2 * sizeof(void*) + value.capacity() + rows.capacity() * sizeof(row_t);
+	}
+
+	// the copy of the indexes (pages which are only kept by snapshots are not counted)
+	if (m_PublishedIndexes) {
+		for (const auto& rows : m_PublishedIndexes->hash) {
+			usage += rows.bucket_count() * sizeof(void*);
+			for (const auto& [value, indexed] : rows)
+				usage += sizeof(hash_rows_t::value_type) + 2 * sizeof(void*) + value.capacity() + indexed.capacity() * sizeof(row_t);
+		}
+
+		for (const auto& index : m_PublishedIndexes->ordered)
+			usage += index.capacity() * sizeof(ordered_rows_t::value_type);
+	}
+
+	for (const auto& dictionary : m_Dictionaries) {
+		usage += sizeof(dictionary_t) + dictionary->values.capacity() * sizeof(std::string) + dictionary->ids.bucket_count() * sizeof(void*);
+		for (const auto& value : dictionary->values) {
+			usage += sizeof(decltype(dictionary->ids)::value_type) + 2 * sizeof(void*);
+			if (value.capacity() > std::string{}.capacity())
+				usage += 2 * (value.capacity() + 1); // the value and its key
+		}
+	}
+
+	for (const auto& page : m_Pages) {
+		usage += sizeof(page_t) + page->ends.capacity() * sizeof(std::array<std::uint16_t, PAGE_SIZE>) + page->ids.capacity() * sizeof(std::array<value_id_t, PAGE_SIZE>);
+		usage += page->numbers.capacity() * sizeof(std::array<double, PAGE_SIZE>) + page->non_numbers.capacity() * sizeof(std::uint64_t);
+		for (const auto& values : { &page->values, &page->overflow }) {
+			for (const auto& value : *values) {
+				if (value.capacity() > std::string{}.capacity())
+					usage += value.capacity() + 1;
+			}
+		}
+	}
+
+	return usage;
+}
@@ -0,0 +1,346 @@
+#pragma once
+#ifndef _GAMESPY_SERVERSTORE_H_
+#define _GAMESPY_SERVERSTORE_H_
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace gamespy {
+	// in-memory registry of the servers of a single game:
+	// - servers are indexed by their public endpoint (open addressing with linear probing)
+	// - rows are stored in pages of PAGE_SIZE rows, each page stores its fields column by column
+	// - the values of a row are stored back to back in a single string (the ends are stored per column)
+	// - column names are interned, so rows only refer to the columns by their index
+	// - numeric columns additionally store their values as doubles (contiguous per page, so filters can scan them with simd)
+	// - other columns intern their values (most of them repeat across many servers, e.g. mapname or gametype):
+	//   rows store the id of the value within the column's dictionary, values which do not fit into it are stored with the row
+	// - values of keys which are not (yet) a column are stored in the row's overflow area (as null-terminated key-value pairs),
+	//   AddColumn moves them into the new column
+	// - columns may have a secondary index: hash (rows by value) or ordered (rows sorted by number)
+	// - every change of the values of a row assigns it a new version (unique within the store), so readers can cache data derived from a row
+	// - Publish creates an immutable snapshot which shares the pages with the store, pages are copied before they are changed again
+	// - hash indexes are updated with every change, snapshots share a copy of the indexes which is refreshed once enough rows changed
+	//   (ordered indexes only exist as those copies, the rows which changed are merged into the previous copy)
+	// Note: not thread-safe, the game serializes the access (snapshots may be read by any number of threads)
+	class ServerStore {
+	public:
+		static constexpr std::size_t PAGE_SIZE = 64;
+		static constexpr std::size_t MAX_ROW_SIZE = 0xFFFF; // all values of a server (far more than fit into a heartbeat)
+		static constexpr std::size_t MAX_OVERFLOW_SIZE = 4 * 1024; // keys and values of the overflow area of a row
+
+		using row_t = std::uint32_t;
+		static constexpr row_t NO_ROW = ~row_t{ 0 };
+
+		using column_t = std::size_t;
+
+		enum class IndexType : std::uint8_t {
+			NONE,
+			HASH, // equality
+			ORDERED // ranges (numeric columns only)
+		};
+		static constexpr std::size_t MAX_INDEXES = 64;
+
+		// ids of interned values, dictionaries are never shrunk (so values of high cardinality like hostname are only interned until it is full)
+		using value_id_t = std::uint16_t;
+		static constexpr value_id_t NO_VALUE_ID = 0xFFFF; // the value is stored with the row
+		static constexpr std::size_t MAX_INTERNED_VALUES = 1024; // per column
+
+		struct Column {
+			const std::string name;
+			const std::string default_value;
+			const std::optional<std::size_t> numbers; // numeric columns: index of the column's numbers within the pages
+			const std::optional<std::size_t> interned; // other columns: index of the column's value ids within the pages and of its dictionary
+			const IndexType index_type = IndexType::NONE;
+			const std::size_t index = 0; // position within the hash- or ordered-indexes
+		};
+
+		// rows sorted by their number, rows whose value is not a number are not part of the index
+		using ordered_rows_t = std::vector<std::pair<double, row_t>>;
+
+		// snapshots copy the indexes once the rows which changed since the last copy exceed 1/UNINDEXED_RATIO of the servers
+		static constexpr std::size_t UNINDEXED_RATIO = 64;
+
+		class Snapshot;
+
+	private:
+		struct page_t {
+			std::uint64_t used = 0; // bitmap of the rows in use
+			std::array<std::uint32_t, PAGE_SIZE> ip{};
+			std::array<std::uint16_t, PAGE_SIZE> port{};
+			std::array<std::chrono::system_clock::time_point, PAGE_SIZE> last_update{};
+			std::array<std::string, PAGE_SIZE> values; // all values of a row
+			std::vector<std::array<std::uint16_t, PAGE_SIZE>> ends; // ends[column][row]: end of the value within values[row]
+			std::vector<std::array<double, PAGE_SIZE>> numbers; // numbers[column.numbers][row]: NaN if the value is not a number
+			std::vector<std::uint64_t> non_numbers; // non_numbers[column.numbers]: bitmap of the rows whose value is not a number
+			std::vector<std::array<value_id_t, PAGE_SIZE>> ids; // ids[column.interned][row]: id of the value (its text is not part of values[row])
+			std::array<std::string, PAGE_SIZE> overflow; // key\0value\0 of the values which are not stored in a column
+			std::array<std::uint64_t, PAGE_SIZE> versions{};
+		};
+
+		struct slot_t {
+			std::uint64_t key = 0;
+			row_t row = NO_ROW;
+		};
+
+		struct string_hash {
+			using is_transparent = void;
+			std::size_t operator()(const std::string_view& value) const noexcept { return std::hash<std::string_view>{}(value); }
+		};
+
+		// interned values of a column, shared with snapshots (the dictionary is copied before a value is added)
+		struct dictionary_t {
+			std::vector<std::string> values;
+			std::unordered_map<std::string, value_id_t, string_hash, std::equal_to<>> ids;
+		};
+
+		using hash_rows_t = std::unordered_map<std::string, std::vector<row_t>, string_hash, std::equal_to<>>; // rows by value (unordered)
+
+		struct hash_index_t {
+			hash_rows_t rows;
+			std::vector<std::uint32_t> positions; // positions[row]: position of the row within the rows of its value
+		};
+
+		// copy of the indexes which is shared by snapshots
+		struct indexes_t {
+			std::vector<hash_rows_t> hash;
+			std::vector<ordered_rows_t> ordered;
+		};
+
+		std::shared_ptr<const std::vector<Column>> m_Columns; // shared by snapshots, replaced when a column is added
+		std::map<std::string, column_t, std::less<>> m_ColumnIds;
+		std::size_t m_NumericColumns = 0;
+		std::vector<std::shared_ptr<dictionary_t>> m_Dictionaries; // by column.interned
+
+		std::vector<column_t> m_IndexedColumns;
+		std::vector<hash_index_t> m_HashIndexes;
+		std::size_t m_OrderedIndexes = 0;
+
+		std::vector<std::shared_ptr<page_t>> m_Pages; // pages which are shared with snapshots are copied on write
+		std::vector<row_t> m_FreeRows;
+		std::vector<slot_t> m_Index; // size is a power of two and at least twice the number of servers
+		std::size_t m_Size = 0;
+
+		std::shared_ptr<const indexes_t> m_PublishedIndexes;
+		std::vector<std::uint64_t> m_Unindexed; // m_Unindexed[page]: bitmap of the rows which were indexed after the indexes were copied
+		std::size_t m_UnindexedRows = 0;
+
+		std::string m_OverflowBuffer; // reused by SetOverflow
+		std::uint64_t m_Version = 0; // last version which was assigned to a row
+
+		static constexpr std::uint64_t Key(std::uint32_t ip, std::uint16_t port) noexcept { return (static_cast<std::uint64_t>(ip) << 16) | port; }
+		std::size_t Slot(std::uint64_t key) const noexcept { return (key * 0x9E3779B97F4A7C15ull) >> (64 - std::countr_zero(m_Index.size())); }
+		void Rehash(std::size_t slots);
+
+		const page_t& Page(row_t row) const noexcept { return *m_Pages[row / PAGE_SIZE]; }
+		page_t& MutablePage(std::size_t page);
+		static void SetNumber(page_t& page, std::size_t pos, std::size_t numbers, const std::string_view& value) noexcept;
+		// id of the value within the dictionary (the value is added if the dictionary is not full), NO_VALUE_ID if it is not interned
+		value_id_t Intern(std::size_t interned, const std::string_view& value);
+
+		template<typename D>
+		static std::string_view Get(const page_t& page, std::size_t pos, const Column& info, column_t column, const D& dictionaries) noexcept
+		{
+			if (info.interned) {
+				if (const auto id = page.ids[*info.interned][pos]; id != NO_VALUE_ID)
+					return dictionaries[*info.interned]->values[id];
+			}
+
+			const std::size_t begin = column ? page.ends[column - 1][pos] : 0;
+			return std::string_view{ page.values[pos] }.substr(begin, page.ends[column][pos] - begin);
+		}
+
+		// calls f(key, value) for every pair of the overflow area until f returns false
+		template<typename F>
+		static void VisitOverflow(std::string_view overflow, F&& f)
+		{
+			while (!overflow.empty()) {
+				const auto key = overflow.substr(0, overflow.find('\0'));
+				overflow.remove_prefix(key.size() + 1);
+				const auto value = overflow.substr(0, overflow.find('\0'));
+				overflow.remove_prefix(value.size() + 1);
+				if (!f(key, value))
+					return;
+			}
+		}
+
+		static std::optional<std::string_view> FindOverflow(const std::string& overflow, const std::string_view& key) noexcept;
+		// removes the pair of the key from the overflow area (if there is one) and returns its value
+		static std::optional<std::string> TakeOverflow(std::string& overflow, const std::string_view& key);
+
+		// the row has to be removed before its value changes and added again afterwards
+		void AddToIndex(row_t row, column_t column);
+		void RemoveFromIndex(row_t row, column_t column);
+		void MarkUnindexed(row_t row) noexcept;
+		ordered_rows_t CopyOrderedIndex(const Column& column, const ordered_rows_t* previous) const;
+
+	public:
+		ServerStore();
+		~ServerStore();
+
+		std::size_t size() const noexcept { return m_Size; }
+
+		const std::vector<Column>& GetColumns() const noexcept { return *m_Columns; }
+		std::optional<column_t> FindColumn(const std::string_view& name) const;
+		// the value of existing rows is taken from their overflow area (if they have one for this key), otherwise it is the default value
+		column_t AddColumn(const std::string_view& name, const std::string_view& defaultValue = {}, bool numeric = false, IndexType indexType = IndexType::NONE);
+
+		// parses values of numeric columns like sqlite's numeric affinity (surrounding spaces are ignored)
+		static std::optional<double> ParseNumber(std::string_view value) noexcept;
+
+		row_t Find(std::uint32_t ip, std::uint16_t port) const noexcept;
+		// returns the row of the server, new rows are initialized with the default values
+		row_t Insert(std::uint32_t ip, std::uint16_t port);
+		bool Erase(std::uint32_t ip, std::uint16_t port);
+
+		std::uint32_t GetIP(row_t row) const noexcept { return Page(row).ip[row % PAGE_SIZE]; }
+		std::uint16_t GetPort(row_t row) const noexcept { return Page(row).port[row % PAGE_SIZE]; }
+		std::chrono::system_clock::time_point GetLastUpdate(row_t row) const noexcept { return Page(row).last_update[row % PAGE_SIZE]; }
+		std::uint64_t GetVersion(row_t row) const noexcept { return Page(row).versions[row % PAGE_SIZE]; }
+		void SetLastUpdate(row_t row, const std::chrono::system_clock::time_point& time) { MutablePage(row / PAGE_SIZE).last_update[row % PAGE_SIZE] = time; }
+
+		std::string_view Get(row_t row, column_t column) const noexcept { return Get(Page(row), row % PAGE_SIZE, (*m_Columns)[column], column, m_Dictionaries); }
+
+		void Set(row_t row, column_t column, const std::string_view& value);
+
+		// replaces the overflow area of the row (keys must not be columns), pairs exceeding MAX_OVERFLOW_SIZE are dropped
+		void SetOverflow(row_t row, const std::span<const std::pair<std::string_view, std::string_view>>& values);
+		std::optional<std::string_view> FindOverflow(row_t row, const std::string_view& key) const noexcept { return FindOverflow(Page(row).overflow[row % PAGE_SIZE], key); }
+
+		// calls f(key, value) for every pair of the overflow area of the row
+		template<typename F>
+		void ForEachOverflow(row_t row, F&& f) const
+		{
+			VisitOverflow(Page(row).overflow[row % PAGE_SIZE], [&f](const std::string_view& key, const std::string_view& value) {
+				f(key, value);
+				return true;
+			});
+		}
+
+		// replaces all values of the row, valueOf(column) returns the new value of the column
+		template<typename F>
+		void Assign(row_t row, F&& valueOf)
+		{
+			auto& page = MutablePage(row / PAGE_SIZE);
+			const auto pos = row % PAGE_SIZE;
+			const auto used = (page.used >> pos) & 1;
+
+			// indexes are only updated for the values which changed (most heartbeats repeat the previous values)
+			auto reindex = std::uint64_t{ 0 };
+			for (std::size_t i = 0; i < m_IndexedColumns.size(); i++) {
+				const auto column = m_IndexedColumns[i];
+				if (used) {
+					if (Get(row, column) == std::string_view{ valueOf(column) })
+						continue;
+
+					RemoveFromIndex(row, column);
+				}
+
+				reindex |= std::uint64_t{ 1 } << i;
+			}
+
+			const auto& columns = *m_Columns;
+			auto& values = page.values[pos];
+			values.clear();
+			for (column_t column = 0; column < columns.size(); column++) {
+				const std::string_view value = std::string_view{ valueOf(column) }.substr(0, MAX_ROW_SIZE - values.size());
+				if (const auto& interned = columns[column].interned) {
+					// most heartbeats repeat the previous value, which does not need to be looked up
+					// (neither are values of rows which did not fit into the dictionary once it is full)
+					auto& id = page.ids[*interned][pos];
+					const auto& dictionary = *m_Dictionaries[*interned];
+					if (!used || (id == NO_VALUE_ID ? dictionary.values.size() < MAX_INTERNED_VALUES : dictionary.values[id] != value))
+						id = Intern(*interned, value);
+					if (id == NO_VALUE_ID)
+						values.append(value);
+				}
+				else
+					values.append(value);
+
+				page.ends[column][pos] = static_cast<std::uint16_t>(values.size());
+				if (columns[column].numbers)
+					SetNumber(page, pos, *columns[column].numbers, value);
+			}
+
+			for (; reindex; reindex &= reindex - 1)
+				AddToIndex(row, m_IndexedColumns[std::countr_zero(reindex)]);
+
+			page.versions[pos] = ++m_Version;
+		}
+
+		// calls f(row) for every server until f returns false
+		template<typename F>
+		void ForEach(F&& f) const
+		{
+			for (std::size_t p = 0; p < m_Pages.size(); p++) {
+				for (auto used = m_Pages[p]->used; used; used &= used - 1) {
+					if (!f(static_cast<row_t>(p * PAGE_SIZE + std::countr_zero(used))))
+						return;
+				}
+			}
+		}
+
+		// immutable copy of the current servers, changes of the store are not visible to the snapshot
+		std::shared_ptr<const Snapshot> Publish();
+
+		// approximation of the allocated memory
+		std::size_t GetMemoryUsage() const noexcept;
+	};
+
+	// servers at the time of ServerStore::Publish, provides the read access of the store (safe to read from any thread)
+	// the indexes of a snapshot may be older than its rows: rows which were indexed since then are listed by GetUnindexedRows
+	class ServerStore::Snapshot {
+		friend class ServerStore;
+
+		std::shared_ptr<const std::vector<Column>> m_Columns;
+		std::vector<std::shared_ptr<const page_t>> m_Pages;
+		std::vector<std::shared_ptr<const dictionary_t>> m_Dictionaries;
+		std::shared_ptr<const indexes_t> m_Indexes;
+		std::vector<std::uint64_t> m_Unindexed;
+		std::size_t m_Size = 0;
+
+		const page_t& Page(row_t row) const noexcept { return *m_Pages[row / PAGE_SIZE]; }
+
+	public:
+		std::size_t size() const noexcept { return m_Size; }
+
+		const std::vector<Column>& GetColumns() const noexcept { return *m_Columns; }
+		std::optional<column_t> FindColumn(const std::string_view& name) const noexcept;
+
+		std::uint32_t GetIP(row_t row) const noexcept { return Page(row).ip[row % PAGE_SIZE]; }
+		std::uint16_t GetPort(row_t row) const noexcept { return Page(row).port[row % PAGE_SIZE]; }
+		std::chrono::system_clock::time_point GetLastUpdate(row_t row) const noexcept { return Page(row).last_update[row % PAGE_SIZE]; }
+		std::uint64_t GetVersion(row_t row) const noexcept { return Page(row).versions[row % PAGE_SIZE]; }
+
+		std::string_view Get(row_t row, column_t column) const noexcept { return ServerStore::Get(Page(row), row % PAGE_SIZE, (*m_Columns)[column], column, m_Dictionaries); }
+		std::optional<std::string_view> FindOverflow(row_t row, const std::string_view& key) const noexcept { return ServerStore::FindOverflow(Page(row).overflow[row % PAGE_SIZE], key); }
+
+		// page-wise access (for scans): rows p * PAGE_SIZE + i of the bits i which are set
+		std::size_t GetPageCount() const noexcept { return m_Pages.size(); }
+		std::uint64_t GetUsedRows(std::size_t page) const noexcept { return m_Pages[page]->used; }
+		const std::array<double, PAGE_SIZE>& GetNumbers(std::size_t page, const Column& column) const noexcept { return m_Pages[page]->numbers[*column.numbers]; }
+		std::uint64_t GetNonNumbers(std::size_t page, const Column& column) const noexcept { return m_Pages[page]->non_numbers[*column.numbers]; }
+		std::uint64_t GetUnindexedRows(std::size_t page) const noexcept { return m_Unindexed[page]; }
+
+		// interned columns: ids of the values of the rows (NO_VALUE_ID if the value is not interned) and the id of a value
+		const std::array<value_id_t, PAGE_SIZE>& GetValueIds(std::size_t page, const Column& column) const noexcept { return m_Pages[page]->ids[*column.interned]; }
+		std::optional<value_id_t> FindValueId(const Column& column, const std::string_view& value) const noexcept;
+
+		// hash index of the column: rows whose value equals `value` (in no particular order)
+		std::span<const row_t> FindRows(const Column& column, const std::string_view& value) const;
+		std::span<const std::pair<double, row_t>> GetOrderedIndex(const Column& column) const noexcept { return m_Indexes->ordered[column.index]; }
+	};
+}
+
+#endif
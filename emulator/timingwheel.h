@@ -0,0 +1,94 @@
+#pragma once
+#ifndef _GAMESPY_TIMINGWHEEL_H_
+#define _GAMESPY_TIMINGWHEEL_H_
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace gamespy {
+	// hashed timing wheel:
+	// every entry is put into the slot of its deadline (in ticks, modulo SLOTS), so advancing the wheel
+	// by one tick only visits the entries of a single slot instead of all scheduled entries
+	// Note: entries are never removed, instead the owner decides what to do once an entry fires
+	//       (e.g. reschedule it because the deadline was extended in the meantime)
+	template<typename T, typename ClockT, std::size_t SLOTS = 64>
+	class TimingWheel {
+	public:
+		using time_point = typename ClockT::time_point;
+		using duration = typename ClockT::duration;
+
+	private:
+		struct entry_t {
+			std::uint64_t tick;
+			T value;
+		};
+
+		const duration m_Tick;
+		const time_point m_Start;
+		std::uint64_t m_CurrentTick = 0; // first tick which has not been processed yet
+		std::array<std::vector<entry_t>, SLOTS> m_Slots;
+		std::size_t m_Size = 0;
+
+		std::uint64_t ToTick(const time_point& time) const noexcept
+		{
+			if (time <= m_Start)
+				return 0;
+
+			return static_cast<std::uint64_t>((time - m_Start) / m_Tick);
+		}
+
+	public:
+		TimingWheel(duration tick, time_point start = ClockT::now())
+			: m_Tick{ tick }, m_Start{ start }
+		{
+
+		}
+
+		std::size_t size() const noexcept { return m_Size; }
+
+		void Schedule(const time_point& deadline, T value)
+		{
+			const auto tick = std::max(ToTick(deadline), m_CurrentTick);
+			m_Slots[tick % SLOTS].push_back(entry_t{ .tick = tick, .value = std::move(value) });
+			m_Size++;
+		}
+
+		// calls onExpired(T&) for every entry whose deadline has been reached,
+		// onExpired may schedule new entries (they will fire with the next call to Advance at the earliest)
+		template<typename F>
+		void Advance(const time_point& now, F&& onExpired)
+		{
+			const auto nowTick = ToTick(now);
+			if (nowTick < m_CurrentTick)
+				return;
+
+			// if more than one revolution elapsed, every slot only needs to be visited once
+			const auto first = m_CurrentTick;
+			const auto last = std::min(nowTick, first + SLOTS - 1);
+			m_CurrentTick = nowTick + 1;
+
+			std::vector<entry_t> slot;
+			for (auto tick = first; tick <= last; tick++) {
+				slot.clear();
+				std::swap(slot, m_Slots[tick % SLOTS]);
+
+				for (auto& entry : slot) {
+					if (entry.tick > nowTick) {
+						// scheduled for a later revolution
+						m_Slots[tick % SLOTS].push_back(std::move(entry));
+						continue;
+					}
+
+					m_Size--;
+					onExpired(entry.value);
+				}
+			}
+		}
+	};
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include <boost/algorithm/string.hpp>
 #include <random>
 #include <sstream>
+#include <stdexcept>
 #include <ranges>
 using namespace gamespy;
 
@@ -55,6 +56,81 @@ namespace {
 		return tmp.append((3 - data.size() % 3) % 3, '=');
 	}
 
+	constexpr auto BASE64 = std::string_view{ "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/" };
+
+	// see utils::make_key_schedule and utils::encode (constexpr, so the known answers below are checked by every build)
+	constexpr utils::key_schedule MakeKeySchedule(const std::string_view& key)
+	{
+		// like RC4 algorithm, but:
+		// - inplace
+		// - PRGA modified (see Encode)
+		utils::key_schedule sbox;
+		for (utils::key_schedule::size_type i = 0; i < sbox.size(); i++)
+			sbox[i] = static_cast<std::uint8_t>(i);
+
+		auto keyLength = key.length();
+		for (std::uint16_t i = 0, j = 0; i < sbox.size(); i++) {
+			j = (j + sbox[i] + key[i % keyLength]) % sbox.size();
+			std::swap(sbox[i], sbox[j]);
+		}
+
+		return sbox;
+	}
+
+	constexpr std::size_t Encode(const utils::key_schedule& schedule, const std::string_view& message, const std::span<char>& out)
+	{
+		if (out.size() < utils::base64_length(message.length()))
+			throw std::length_error{ "encode output buffer too small" };
+
+		// the s-box is modified while encoding, so every message starts from a copy of the key schedule
+		auto sbox = schedule;
+		std::uint8_t i = 0, j = 0;
+		const auto next = [&](std::uint8_t c) -> std::uint32_t {
+			i = i + c + 1; // deviation to RC4
+			j = j + sbox[i];
+			std::swap(sbox[i], sbox[j]);
+			return c ^ sbox[static_cast<std::uint8_t>(sbox[i] + sbox[j])];
+		};
+
+		// base64 is generated on the fly (3 encoded bytes => 4 chars)
+		// Note: next modifies the s-box, so the bytes must be encoded in separate statements (in order)
+		std::size_t written = 0, pos = 0;
+		const auto length = message.length();
+		for (; pos + 3 <= length; pos += 3) {
+			const auto first = next(message[pos]);
+			const auto second = next(message[pos + 1]);
+			const auto third = next(message[pos + 2]);
+			const auto block = (first << 16) | (second << 8) | third;
+			out[written++] = BASE64[(block >> 18) & 0x3F];
+			out[written++] = BASE64[(block >> 12) & 0x3F];
+			out[written++] = BASE64[(block >> 6) & 0x3F];
+			out[written++] = BASE64[block & 0x3F];
+		}
+
+		if (const auto remaining = length - pos; remaining > 0) {
+			auto block = next(message[pos]) << 16;
+			if (remaining > 1)
+				block |= next(message[pos + 1]) << 8;
+
+			out[written++] = BASE64[(block >> 18) & 0x3F];
+			out[written++] = BASE64[(block >> 12) & 0x3F];
+			out[written++] = remaining > 1 ? BASE64[(block >> 6) & 0x3F] : '=';
+			out[written++] = '=';
+		}
+
+		return written;
+	}
+
+	// known answers of the former per-byte implementation (RC4-like pass over the whole message, then boost base64)
+	constexpr bool EncodesTo(const std::string_view& key, const std::string_view& message, const std::string_view& expected)
+	{
+		auto out = std::array<char, 64>{};
+		const auto length = Encode(MakeKeySchedule(key), message, out);
+		return std::string_view{ out.data(), length } == expected;
+	}
+	static_assert(EncodesTo("HpWx9z", "abcdefghijklmnopqrstu", "usS91QNeC8Ej+0LS+DzLj/sfFegu"));
+	static_assert(EncodesTo("Ah6ATx", "0123456789", "WauC6LO29PBvvA=="));
+
 	std::string gspassenc(const std::string& password) {
 		auto rnd = std::minstd_rand0{ 0x79707367 }; // "gspy"
 
@@ -75,30 +151,35 @@ std::string utils::random_string(const std::string& table, std::string::size_typ
 	return result;
 }
 
+std::uint64_t utils::random_key()
+{
+	thread_local auto rng = random_generator<std::mt19937_64>();
+	return rng();
+}
+
+utils::key_schedule utils::make_key_schedule(const std::string_view& key)
+{
+	if (key.empty())
+		throw std::invalid_argument{ "key schedule of an empty key" };
+
+	return MakeKeySchedule(key);
+}
+
 std::string utils::encode(const std::string_view& key, std::string message)
 {
-	// like RC4 algorithm, but:
-	// - inplace
-	// - PRGA modified (see comment below)
-	std::array<std::uint8_t, 256> sbox;
-	for (decltype(sbox)::size_type i = 0; i < sbox.size(); i++)
-		sbox[i] = static_cast<std::uint8_t>(i);
-
-	auto keyLength = key.length();
-	for (std::uint16_t i = 0, j = 0; i < sbox.size(); i++) {
-		j = (j + sbox[i] + key[i % keyLength]) % sbox.size();
-		std::swap(sbox[i], sbox[j]);
-	}
+	return encode(make_key_schedule(key), message);
+}
 
-	std::uint16_t i = 0, j = 0;
-	for (auto& c : message) {
-		i = (i + c + 1) % sbox.size(); // deviation to RC4
-		j = (j + sbox[i]) % sbox.size();
-		std::swap(sbox[i], sbox[j]);
-		c ^= sbox[(sbox[i] + sbox[j]) % sbox.size()];
-	}
+std::string utils::encode(const key_schedule& schedule, const std::string_view& message)
+{
+	auto encoded = std::string(base64_length(message.length()), '\0');
+	encoded.resize(encode(schedule, message, encoded));
+	return encoded;
+}
 
-	return base64_encode(message);
+std::size_t utils::encode(const key_schedule& schedule, const std::string_view& message, const std::span<char>& out)
+{
+	return Encode(schedule, message, out);
 }
 
 std::string utils::passencode(const std::string& password)
@@ -12,7 +12,23 @@ namespace gamespy {
 	namespace utils {
 		std::string random_string(const std::string& table, std::string::size_type len);
 
+		// random 64-bit value, e.g. the per-process key of a hash whose buckets must not be predictable
+		std::uint64_t random_key();
+
+		// initial s-box of encode, it only depends on the passphrase (e.g. the secret key of a game) and can be reused
+		// throws std::invalid_argument if the passphrase is empty
+		using key_schedule = std::array<std::uint8_t, 256>;
+		key_schedule make_key_schedule(const std::string_view& passphrase);
+
 		std::string encode(const std::string_view& passphrase, std::string message);
+		std::string encode(const key_schedule& schedule, const std::string_view& message);
+
+		// allocation free variant, out needs to hold at least base64_length(message.length()) chars
+		// returns the number of chars written to out
+		std::size_t encode(const key_schedule& schedule, const std::string_view& message, const std::span<char>& out);
+
+		constexpr std::size_t base64_length(std::size_t length) noexcept { return (length + 2) / 3 * 4; }
+
 		std::string passencode(const std::string& password);
 		std::string passdecode(std::string password);
 
@@ -29,5 +45,29 @@ namespace gamespy {
 		}
 
 		std::string md5(const std::string_view& text);
+
+		// 64-bit FNV-1a, pass the previous result as hash to continue hashing
+		constexpr std::uint64_t fnv1a(const std::string_view& data, std::uint64_t hash = 0xCBF29CE484222325) noexcept
+		{
+			for (const auto& c : data) {
+				hash ^= static_cast<std::uint8_t>(c);
+				hash *= 0x100000001B3;
+			}
+
+			return hash;
+		}
+
+		// fnv1a seeded with a secret key (see random_key), the result is mixed (murmur3 finalizer)
+		// so that every bit of the key affects the low bits, which are used as bucket index
+		constexpr std::uint64_t keyed_hash(const std::string_view& data, std::uint64_t key) noexcept
+		{
+			auto hash = fnv1a(data, key);
+			hash ^= hash >> 33;
+			hash *= 0xFF51AFD7ED558CCD;
+			hash ^= hash >> 33;
+			hash *= 0xC4CEB9FE1A85EC53;
+			hash ^= hash >> 33;
+			return hash;
+		}
 	}
 }
\ No newline at end of file